@@ -0,0 +1,53 @@
+#include "mgw-source/filters/common/mgw/mgw.h"
+
+#include <vector>
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+// Responses kept per thread. A completion callback can start another call that completes inline,
+// so a few may be out at once; anything beyond this is freed.
+constexpr size_t MaxFreeResponses = 16;
+
+std::vector<std::unique_ptr<Response>>& freeResponses() {
+  static thread_local std::vector<std::unique_ptr<Response>> free_responses;
+  return free_responses;
+}
+
+} // namespace
+
+void ResponseDeleter::operator()(Response* response) const {
+  std::vector<std::unique_ptr<Response>>& free_responses = freeResponses();
+  if (free_responses.size() >= MaxFreeResponses) {
+    delete response;
+    return;
+  }
+  // Clearing rather than reassigning keeps the capacity of the headers and the body.
+  response->status = CheckStatus::OK;
+  response->headers_to_append.clear();
+  response->headers_to_add.clear();
+  response->body.clear();
+  response->status_code = Http::Code{};
+  free_responses.emplace_back(response);
+}
+
+ResponsePtr createResponse() {
+  std::vector<std::unique_ptr<Response>>& free_responses = freeResponses();
+  if (free_responses.empty()) {
+    return ResponsePtr(new Response{});
+  }
+  ResponsePtr response(free_responses.back().release());
+  free_responses.pop_back();
+  return response;
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -60,7 +60,21 @@ struct Response {
   Http::Code status_code{};
 };
 
-using ResponsePtr = std::unique_ptr<Response>;
+/**
+ * Hands a Response back to the free list of the calling thread. @see createResponse()
+ */
+struct ResponseDeleter {
+  void operator()(Response* response) const;
+};
+
+using ResponsePtr = std::unique_ptr<Response, ResponseDeleter>;
+
+/**
+ * @return an empty Response. Responses are recycled through a free list per thread: callers
+ * release them as soon as the completion callback returns, so a worker only ever needs a few and
+ * completing a call does not allocate.
+ */
+ResponsePtr createResponse();
 
 /**
  * Async callbacks used during response incept() calls.
@@ -102,6 +116,64 @@ public:
 
 using ResClientPtr = std::unique_ptr<ResClient>;
 
+/**
+ * Fire-and-forget sink for intercept requests. Used when the filter only observes responses and
+ * does not wait for the service to answer.
+ */
+class ResPublisher {
+public:
+  virtual ~ResPublisher() = default;
+
+  /**
+   * Hand a request off to the mgw response service. This never blocks the caller and the outcome
+   * of the call is not reported back.
+   * @param request is the proto message with the attributes of the specific payload.
+   */
+  virtual void publish(const envoy::service::mgw_res::v3::CheckRequest& request) PURE;
+};
+
+using ResPublisherPtr = std::unique_ptr<ResPublisher>;
+
+/**
+ * Async callbacks used during request intercept() calls.
+ */
+class RequestCallbacks {
+public:
+  virtual ~RequestCallbacks() = default;
+
+  /**
+   * Called when a request intercept call is complete. The resulting ResponsePtr is supplied.
+   */
+  virtual void onRequestComplete(ResponsePtr&& response) PURE;
+};
+
+class ReqClient {
+public:
+  // Destructor
+  virtual ~ReqClient() = default;
+
+  /**
+   * Cancel an inflight request intercept call.
+   */
+  virtual void cancel() PURE;
+
+  /**
+   * Request a check call to an external authorization service which decides whether the
+   * request may be forwarded.
+   * @param callback supplies the completion callbacks.
+   *        NOTE: The callback may happen within the calling stack.
+   * @param request is the proto message with the attributes of the request.
+   * @param parent_span source for generating an egress child span as part of the trace.
+   * @param stream_info supplies the client's stream info.
+   */
+  virtual void intercept(RequestCallbacks& callback,
+                         const envoy::service::auth::v3::CheckRequest& request,
+                         Tracing::Span& parent_span,
+                         const StreamInfo::StreamInfo& stream_info) PURE;
+};
+
+using ReqClientPtr = std::unique_ptr<ReqClient>;
+
 } // namespace MGW
 } // namespace Common
 } // namespace Filters
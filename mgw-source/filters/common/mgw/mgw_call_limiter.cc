@@ -0,0 +1,146 @@
+#include "mgw-source/filters/common/mgw/mgw_call_limiter.h"
+
+#include <algorithm>
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+// Multiplicative decrease applied when a call is slower than the target.
+constexpr double LimitBackoff = 0.9;
+
+} // namespace
+
+CallLimiter::CallLimiter(const CallLimiterConfig& config, const CallLimiterStatsSharedPtr& stats,
+                         TimeSource& time_source)
+    : config_(config), stats_(stats), time_source_(time_source) {
+  // An adaptive limit starts from the top and backs off once the service is slow.
+  setLimit(config_.max_limit_);
+}
+
+CallLimiter::~CallLimiter() {
+  setLimit(0);
+  setOpen(false);
+}
+
+CallLimiterStats CallLimiter::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_MGW_CALL_LIMITER_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                     POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+CallLimiter::Admission CallLimiter::tryAdmit() {
+  Admission admission = Admission::Admitted;
+  if (open_) {
+    if (trial_in_flight_ || time_source_.monotonicTime() < open_until_) {
+      stats_->circuit_rejected_.inc();
+      return Admission::Rejected;
+    }
+    // Half open: this call decides whether the breaker closes.
+    trial_in_flight_ = true;
+    admission = Admission::Trial;
+  } else if (config_.max_limit_ > 0 && active_ >= limit()) {
+    stats_->over_limit_.inc();
+    return Admission::Rejected;
+  }
+  ++active_;
+  return admission;
+}
+
+void CallLimiter::onCallComplete(Admission admission, std::chrono::milliseconds latency,
+                                 bool error) {
+  ASSERT(admission != Admission::Rejected);
+  ASSERT(active_ > 0);
+  --active_;
+
+  if (config_.max_limit_ > 0 && config_.target_latency_.has_value()) {
+    if (latency <= config_.target_latency_.value()) {
+      setLimit(limit_ + 1.0 / limit_);
+    } else {
+      // At most one decrease per round trip: a burst of slow calls backs off once.
+      const MonotonicTime now = time_source_.monotonicTime();
+      if (now - latency >= last_decrease_) {
+        setLimit(limit_ * LimitBackoff);
+        last_decrease_ = now;
+      }
+    }
+  }
+
+  if (config_.consecutive_errors_ == 0) {
+    return;
+  }
+  if (admission == Admission::Trial) {
+    trial_in_flight_ = false;
+    if (!error) {
+      consecutive_errors_ = 0;
+      setOpen(false);
+    } else {
+      open_until_ = time_source_.monotonicTime() + config_.open_interval_;
+    }
+    return;
+  }
+  if (open_) {
+    // Started before the breaker opened, it says nothing about the service now.
+    return;
+  }
+  if (!error) {
+    consecutive_errors_ = 0;
+    return;
+  }
+  if (++consecutive_errors_ >= config_.consecutive_errors_) {
+    stats_->circuit_opened_.inc();
+    setOpen(true);
+    open_until_ = time_source_.monotonicTime() + config_.open_interval_;
+  }
+}
+
+void CallLimiter::onCallCancelled(Admission admission) {
+  ASSERT(admission != Admission::Rejected);
+  ASSERT(active_ > 0);
+  --active_;
+  if (admission == Admission::Trial) {
+    // A cancelled trial gives no verdict; the next call gets to try.
+    trial_in_flight_ = false;
+  }
+}
+
+void CallLimiter::setLimit(double value) {
+  if (config_.max_limit_ == 0) {
+    return;
+  }
+  const uint32_t previous = limit();
+  if (value > 0) {
+    limit_ = std::max<double>(config_.min_limit_, std::min<double>(config_.max_limit_, value));
+  } else {
+    limit_ = 0;
+  }
+  // The gauge is the sum over all workers.
+  if (limit() > previous) {
+    stats_->concurrency_limit_.add(limit() - previous);
+  } else {
+    stats_->concurrency_limit_.sub(previous - limit());
+  }
+}
+
+void CallLimiter::setOpen(bool open) {
+  if (open == open_) {
+    return;
+  }
+  open_ = open;
+  if (open_) {
+    stats_->circuit_open_.inc();
+  } else {
+    stats_->circuit_open_.dec();
+  }
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "envoy/common/time.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the intercept call limiter. @see stats_macros.h
+ */
+#define ALL_MGW_CALL_LIMITER_STATS(COUNTER, GAUGE)                                                 \
+  COUNTER(over_limit)                                                                              \
+  COUNTER(circuit_rejected)                                                                        \
+  COUNTER(circuit_opened)                                                                          \
+  GAUGE(circuit_open, Accumulate)                                                                  \
+  GAUGE(concurrency_limit, Accumulate)
+
+/**
+ * Wrapper struct for intercept call limiter stats. @see stats_macros.h
+ */
+struct CallLimiterStats {
+  ALL_MGW_CALL_LIMITER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+using CallLimiterStatsSharedPtr = std::shared_ptr<CallLimiterStats>;
+
+/**
+ * Settings of the intercept call limiter. A limit of 0 disables the concurrency limit and
+ * consecutive_errors of 0 disables the circuit breaker.
+ */
+struct CallLimiterConfig {
+  uint32_t max_limit_;
+  // Adaptive limit, only if target_latency_ is set.
+  absl::optional<std::chrono::milliseconds> target_latency_;
+  uint32_t min_limit_;
+  // Circuit breaker.
+  uint32_t consecutive_errors_;
+  std::chrono::milliseconds open_interval_;
+};
+
+/**
+ * Per worker gate in front of the sync intercept calls: a fixed or adaptive bound on the calls in
+ * flight plus a consecutive error circuit breaker. Every admitted call must be ended with exactly
+ * one of onCallComplete() or onCallCancelled(), passing back its admission. Not thread safe.
+ */
+class CallLimiter {
+public:
+  enum class Admission {
+    Rejected,
+    Admitted,
+    // The single call of a half open breaker, only its outcome closes the breaker.
+    Trial,
+  };
+
+  CallLimiter(const CallLimiterConfig& config, const CallLimiterStatsSharedPtr& stats,
+              TimeSource& time_source);
+  ~CallLimiter();
+
+  static CallLimiterStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  /**
+   * @return whether a call may be made now. Rejections are counted.
+   */
+  Admission tryAdmit();
+
+  /**
+   * Ends an admitted call that got an answer or failed.
+   * @param admission what tryAdmit() returned for the call.
+   * @param latency how long the call took.
+   * @param error whether the call failed.
+   */
+  void onCallComplete(Admission admission, std::chrono::milliseconds latency, bool error);
+
+  /**
+   * Ends an admitted call that was cancelled. It says nothing about the service.
+   * @param admission what tryAdmit() returned for the call.
+   */
+  void onCallCancelled(Admission admission);
+
+private:
+  uint32_t limit() const { return static_cast<uint32_t>(limit_); }
+  void setLimit(double value);
+  void setOpen(bool open);
+
+  const CallLimiterConfig config_;
+  CallLimiterStatsSharedPtr stats_;
+  TimeSource& time_source_;
+  uint32_t active_{};
+  // Fractional so that additive increase can add less than one per call.
+  double limit_{};
+  // Calls started before the last decrease saw the old limit, they don't decrease it again.
+  MonotonicTime last_decrease_;
+  uint32_t consecutive_errors_{};
+  bool open_{};
+  MonotonicTime open_until_;
+  // Set while the single trial call of a half open breaker is in flight.
+  bool trial_in_flight_{};
+};
+
+using CallLimiterPtr = std::unique_ptr<CallLimiter>;
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
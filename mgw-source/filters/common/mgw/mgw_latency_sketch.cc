@@ -0,0 +1,102 @@
+#include "mgw-source/filters/common/mgw/mgw_latency_sketch.h"
+
+#include <cmath>
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+LatencySketch::LatencySketch(double relative_accuracy)
+    : relative_accuracy_(relative_accuracy),
+      gamma_((1.0 + relative_accuracy) / (1.0 - relative_accuracy)),
+      inverse_log_gamma_(1.0 / std::log(gamma_)) {
+  ASSERT(relative_accuracy > 0 && relative_accuracy < 1);
+}
+
+void LatencySketch::record(uint64_t value_ns) {
+  count_++;
+  if (value_ns <= 1) {
+    zero_count_++;
+    return;
+  }
+  addToBucket(bucketIndex(value_ns), 1);
+}
+
+void LatencySketch::merge(const LatencySketch& other) {
+  ASSERT(relative_accuracy_ == other.relative_accuracy_);
+  count_ += other.count_;
+  zero_count_ += other.zero_count_;
+  for (size_t i = 0; i < other.counts_.size(); i++) {
+    if (other.counts_[i] != 0) {
+      addToBucket(other.offset_ + static_cast<int32_t>(i), other.counts_[i]);
+    }
+  }
+}
+
+uint64_t LatencySketch::quantile(double quantile) const {
+  ASSERT(quantile >= 0 && quantile <= 1);
+  if (count_ == 0) {
+    return 0;
+  }
+  const uint64_t rank = static_cast<uint64_t>(quantile * (count_ - 1));
+  if (rank < zero_count_) {
+    return 0;
+  }
+  uint64_t seen = zero_count_;
+  for (size_t i = 0; i < counts_.size(); i++) {
+    seen += counts_[i];
+    if (seen > rank) {
+      // Bucket i covers (g^(i-1), g^i]. This point is within the relative accuracy of both ends.
+      return static_cast<uint64_t>(2.0 * std::pow(gamma_, offset_ + static_cast<int32_t>(i)) /
+                                   (gamma_ + 1.0));
+    }
+  }
+  NOT_REACHED_GCOVR_EXCL_LINE;
+}
+
+void LatencySketch::clear() {
+  offset_ = 0;
+  counts_.clear();
+  zero_count_ = 0;
+  count_ = 0;
+}
+
+void LatencySketch::toProto(envoy::service::mgw_res::v3::LatencySketch& proto) const {
+  proto.set_relative_accuracy(relative_accuracy_);
+  proto.set_offset(offset_);
+  proto.set_zero_count(zero_count_);
+  proto.mutable_counts()->Reserve(counts_.size());
+  for (const uint64_t count : counts_) {
+    proto.add_counts(count);
+  }
+}
+
+int32_t LatencySketch::bucketIndex(uint64_t value_ns) const {
+  return static_cast<int32_t>(std::ceil(std::log(static_cast<double>(value_ns)) *
+                                        inverse_log_gamma_));
+}
+
+void LatencySketch::addToBucket(int32_t index, uint64_t count) {
+  if (counts_.empty()) {
+    offset_ = index;
+    counts_.push_back(count);
+    return;
+  }
+  if (index < offset_) {
+    counts_.insert(counts_.begin(), offset_ - index, 0);
+    offset_ = index;
+  } else if (index >= offset_ + static_cast<int32_t>(counts_.size())) {
+    counts_.resize(index - offset_ + 1, 0);
+  }
+  counts_[index - offset_] += count;
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
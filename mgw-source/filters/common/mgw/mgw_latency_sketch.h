@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * Mergeable latency histogram with log sized buckets (DDSketch). Any value is reported with a
+ * relative error of at most the configured accuracy, and two sketches of the same accuracy merge
+ * by adding bucket counts. Memory grows with the log of the value range, not the value count.
+ */
+class LatencySketch {
+public:
+  static constexpr double DefaultRelativeAccuracy = 0.01;
+
+  LatencySketch() : LatencySketch(DefaultRelativeAccuracy) {}
+  explicit LatencySketch(double relative_accuracy);
+
+  /**
+   * Adds a value to the sketch.
+   * @param value_ns supplies the latency in nanoseconds.
+   */
+  void record(uint64_t value_ns);
+
+  /**
+   * Adds all the values of another sketch built with the same accuracy.
+   */
+  void merge(const LatencySketch& other);
+
+  /**
+   * @return the number of recorded values.
+   */
+  uint64_t count() const { return count_; }
+
+  /**
+   * @return an estimate of the given quantile in nanoseconds, within the relative accuracy of
+   * the sketch. 0 if the sketch is empty.
+   * @param quantile supplies a value in [0, 1].
+   */
+  uint64_t quantile(double quantile) const;
+
+  /**
+   * Removes all values. The buckets keep their memory for the values recorded next.
+   */
+  void clear();
+
+  void toProto(envoy::service::mgw_res::v3::LatencySketch& proto) const;
+
+private:
+  int32_t bucketIndex(uint64_t value_ns) const;
+  void addToBucket(int32_t index, uint64_t count);
+
+  double relative_accuracy_;
+  double gamma_;
+  double inverse_log_gamma_;
+  // counts_[i] holds bucket offset_ + i.
+  int32_t offset_{};
+  std::vector<uint64_t> counts_;
+  uint64_t zero_count_{};
+  uint64_t count_{};
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
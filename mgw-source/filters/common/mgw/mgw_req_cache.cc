@@ -0,0 +1,82 @@
+#include "mgw-source/filters/common/mgw/mgw_req_cache.h"
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+ReqDecisionCache::ReqDecisionCache(const ReqCacheConfig& config,
+                                   const ReqCacheStatsSharedPtr& stats, TimeSource& time_source)
+    : config_(config), stats_(stats), time_source_(time_source) {}
+
+ReqDecisionCache::~ReqDecisionCache() { stats_->entries_.sub(lru_.size()); }
+
+ReqCacheStats ReqDecisionCache::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_MGW_REQ_CACHE_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                  POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+const CachedDecision* ReqDecisionCache::lookup(absl::string_view key) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    stats_->miss_.inc();
+    return nullptr;
+  }
+
+  EntryList::iterator entry = it->second;
+  if (entry->expiry_ <= time_source_.monotonicTime()) {
+    stats_->expired_.inc();
+    stats_->miss_.inc();
+    erase(entry);
+    return nullptr;
+  }
+
+  stats_->hit_.inc();
+  lru_.splice(lru_.begin(), lru_, entry);
+  return &entry->decision_;
+}
+
+void ReqDecisionCache::insert(absl::string_view key, const Response& response) {
+  if (response.status == CheckStatus::Error) {
+    return;
+  }
+  if (key.size() + response.body.size() > config_.max_entry_bytes_) {
+    stats_->oversize_.inc();
+    return;
+  }
+
+  const MonotonicTime expiry = time_source_.monotonicTime() + config_.ttl_;
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    // Several streams missed on the same key while the first call was in flight.
+    EntryList::iterator entry = it->second;
+    entry->decision_ = {response.status, response.status_code, response.body};
+    entry->expiry_ = expiry;
+    lru_.splice(lru_.begin(), lru_, entry);
+    return;
+  }
+
+  if (lru_.size() >= config_.max_entries_) {
+    stats_->eviction_.inc();
+    erase(std::prev(lru_.end()));
+  }
+  lru_.push_front(
+      {std::string(key), {response.status, response.status_code, response.body}, expiry});
+  index_.emplace(lru_.front().key_, lru_.begin());
+  stats_->entries_.inc();
+}
+
+void ReqDecisionCache::erase(EntryList::iterator it) {
+  index_.erase(it->key_);
+  lru_.erase(it);
+  stats_->entries_.dec();
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "envoy/common/time.h"
+#include "envoy/http/codes.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "mgw-source/filters/common/mgw/mgw.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the request decision cache. @see stats_macros.h
+ */
+#define ALL_MGW_REQ_CACHE_STATS(COUNTER, GAUGE)                                                    \
+  COUNTER(hit)                                                                                     \
+  COUNTER(miss)                                                                                    \
+  COUNTER(expired)                                                                                 \
+  COUNTER(eviction)                                                                                \
+  COUNTER(oversize)                                                                                \
+  GAUGE(entries, Accumulate)
+
+/**
+ * Wrapper struct for request decision cache stats. @see stats_macros.h
+ */
+struct ReqCacheStats {
+  ALL_MGW_REQ_CACHE_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+using ReqCacheStatsSharedPtr = std::shared_ptr<ReqCacheStats>;
+
+/**
+ * Limits of the request decision cache.
+ */
+struct ReqCacheConfig {
+  std::chrono::milliseconds ttl_;
+  uint32_t max_entries_;
+  uint32_t max_entry_bytes_;
+};
+
+/**
+ * A cached allow or deny decision.
+ */
+struct CachedDecision {
+  CheckStatus status_;
+  // Only set for denied requests.
+  Http::Code status_code_;
+  std::string body_;
+};
+
+/**
+ * Per worker LRU cache of request decisions, each valid for a fixed time to live. Memory is
+ * bounded by max_entries * max_entry_bytes plus a constant per entry. Not thread safe.
+ */
+class ReqDecisionCache {
+public:
+  ReqDecisionCache(const ReqCacheConfig& config, const ReqCacheStatsSharedPtr& stats,
+                   TimeSource& time_source);
+  ~ReqDecisionCache();
+
+  static ReqCacheStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  /**
+   * @return the live decision for the key or nullptr. The pointer is only valid until the next
+   * call into the cache.
+   */
+  const CachedDecision* lookup(absl::string_view key);
+
+  /**
+   * Caches an OK or Denied response. Errors are ignored.
+   */
+  void insert(absl::string_view key, const Response& response);
+
+private:
+  struct Entry {
+    std::string key_;
+    CachedDecision decision_;
+    MonotonicTime expiry_;
+  };
+  using EntryList = std::list<Entry>;
+
+  void erase(EntryList::iterator it);
+
+  const ReqCacheConfig config_;
+  ReqCacheStatsSharedPtr stats_;
+  TimeSource& time_source_;
+  // Most recently used first.
+  EntryList lru_;
+  // Keys are views of Entry::key_, which never moves since list nodes are stable.
+  absl::flat_hash_map<absl::string_view, EntryList::iterator> index_;
+};
+
+using ReqDecisionCachePtr = std::unique_ptr<ReqDecisionCache>;
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,76 @@
+#include "mgw-source/filters/common/mgw/mgw_req_grpc_impl.h"
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+constexpr char CheckMethod[] = "envoy.service.auth.v3.Authorization.Check";
+
+GrpcReqClientImpl::GrpcReqClientImpl(const Grpc::RawAsyncClientSharedPtr& async_client,
+                                     const absl::optional<std::chrono::milliseconds>& timeout)
+    : service_method_(getMethodDescriptor()), async_client_(async_client), timeout_(timeout) {}
+
+GrpcReqClientImpl::~GrpcReqClientImpl() { ASSERT(!callbacks_); }
+
+void GrpcReqClientImpl::cancel() {
+  ASSERT(callbacks_ != nullptr);
+  request_->cancel();
+  callbacks_ = nullptr;
+}
+
+void GrpcReqClientImpl::intercept(RequestCallbacks& callbacks,
+                                  const envoy::service::auth::v3::CheckRequest& request,
+                                  Tracing::Span& parent_span, const StreamInfo::StreamInfo&) {
+  ASSERT(callbacks_ == nullptr);
+  callbacks_ = &callbacks;
+  request_ = async_client_->send(service_method_, request, *this, parent_span,
+                                 Http::AsyncClient::RequestOptions().setTimeout(timeout_));
+}
+
+void GrpcReqClientImpl::onSuccess(
+    std::unique_ptr<envoy::service::auth::v3::CheckResponse>&& response, Tracing::Span& span) {
+  ResponsePtr mgw_response = createResponse();
+  if (response->status().code() == Grpc::Status::WellKnownGrpcStatus::Ok) {
+    span.setTag(TracingConstants::get().TraceStatus, TracingConstants::get().TraceOk);
+    mgw_response->status = CheckStatus::OK;
+  } else {
+    span.setTag(TracingConstants::get().TraceStatus, TracingConstants::get().TraceUnauthz);
+    mgw_response->status = CheckStatus::Denied;
+    const auto& denied = response->denied_response();
+    mgw_response->status_code =
+        denied.has_status() && denied.status().code() != 0
+            ? static_cast<Http::Code>(denied.status().code())
+            : Http::Code::Forbidden;
+    mgw_response->body = denied.body();
+  }
+
+  callbacks_->onRequestComplete(std::move(mgw_response));
+  callbacks_ = nullptr;
+}
+
+void GrpcReqClientImpl::onFailure(Grpc::Status::GrpcStatus status, const std::string&,
+                                  Tracing::Span&) {
+  ASSERT(status != Grpc::Status::WellKnownGrpcStatus::Ok);
+  ResponsePtr response = createResponse();
+  response->status = CheckStatus::Error;
+  response->status_code = Http::Code::Forbidden;
+  callbacks_->onRequestComplete(std::move(response));
+  callbacks_ = nullptr;
+}
+
+const Protobuf::MethodDescriptor& GrpcReqClientImpl::getMethodDescriptor() {
+  const auto* descriptor =
+      Protobuf::DescriptorPool::generated_pool()->FindMethodByName(CheckMethod);
+  ASSERT(descriptor != nullptr);
+  return *descriptor;
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
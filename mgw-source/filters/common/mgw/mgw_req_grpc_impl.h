@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "envoy/grpc/async_client.h"
+#include "envoy/service/auth/v3/external_auth.pb.h"
+#include "envoy/tracing/http_tracer.h"
+
+#include "common/grpc/typed_async_client.h"
+
+#include "mgw-source/filters/common/mgw/mgw.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+using MGWAsyncReqCallbacks = Grpc::AsyncRequestCallbacks<envoy::service::auth::v3::CheckResponse>;
+
+/*
+ * Request path client. Calls an envoy.service.auth.v3.Authorization service and maps its answer
+ * onto CheckStatus. Like GrpcResClientImpl it is created per filter stack and borrows the async
+ * client of the worker.
+ */
+class GrpcReqClientImpl : public ReqClient, public MGWAsyncReqCallbacks {
+public:
+  GrpcReqClientImpl(const Grpc::RawAsyncClientSharedPtr& async_client,
+                    const absl::optional<std::chrono::milliseconds>& timeout);
+  ~GrpcReqClientImpl() override;
+
+  // MGW::ReqClient
+  void cancel() override;
+  void intercept(RequestCallbacks& callbacks, const envoy::service::auth::v3::CheckRequest& request,
+                 Tracing::Span& parent_span, const StreamInfo::StreamInfo& stream_info) override;
+
+  // Grpc::AsyncRequestCallbacks
+  void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+  void onSuccess(std::unique_ptr<envoy::service::auth::v3::CheckResponse>&& response,
+                 Tracing::Span& span) override;
+  void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                 Tracing::Span& span) override;
+
+private:
+  static const Protobuf::MethodDescriptor& getMethodDescriptor();
+
+  const Protobuf::MethodDescriptor& service_method_;
+  Grpc::AsyncClient<envoy::service::auth::v3::CheckRequest,
+                    envoy::service::auth::v3::CheckResponse>
+      async_client_;
+  Grpc::AsyncRequest* request_{};
+  absl::optional<std::chrono::milliseconds> timeout_;
+  RequestCallbacks* callbacks_{};
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
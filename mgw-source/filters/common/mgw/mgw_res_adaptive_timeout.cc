@@ -0,0 +1,38 @@
+#include "mgw-source/filters/common/mgw/mgw_res_adaptive_timeout.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+AdaptiveTimeout::AdaptiveTimeout(const AdaptiveTimeoutConfig& config,
+                                 const AdaptiveTimeoutStatsSharedPtr& stats)
+    : config_(config), stats_(stats), timeout_(config.max_timeout_) {}
+
+AdaptiveTimeoutStats AdaptiveTimeout::generateStats(const std::string& prefix,
+                                                    Stats::Scope& scope) {
+  return {ALL_MGW_ADAPTIVE_TIMEOUT_STATS(POOL_HISTOGRAM_PREFIX(scope, prefix))};
+}
+
+void AdaptiveTimeout::onCallComplete(std::chrono::milliseconds latency) {
+  window_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  if (window_.count() < config_.window_calls_) {
+    return;
+  }
+  const double quantile_ms = window_.quantile(config_.quantile_) / 1e6;
+  const std::chrono::milliseconds timeout(
+      static_cast<int64_t>(std::ceil(quantile_ms * (1 + config_.headroom_))));
+  timeout_ = std::min(std::max(timeout, config_.min_timeout_), config_.max_timeout_);
+  stats_->timeout_.recordValue(timeout_.count());
+  window_.clear();
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+
+#include "mgw-source/filters/common/mgw/mgw_latency_sketch.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the adaptive intercept timeout. @see stats_macros.h
+ */
+#define ALL_MGW_ADAPTIVE_TIMEOUT_STATS(HISTOGRAM) HISTOGRAM(timeout, Milliseconds)
+
+/**
+ * Wrapper struct for adaptive intercept timeout stats. @see stats_macros.h
+ */
+struct AdaptiveTimeoutStats {
+  ALL_MGW_ADAPTIVE_TIMEOUT_STATS(GENERATE_HISTOGRAM_STRUCT)
+};
+
+using AdaptiveTimeoutStatsSharedPtr = std::shared_ptr<AdaptiveTimeoutStats>;
+
+/**
+ * Settings of the adaptive intercept timeout.
+ */
+struct AdaptiveTimeoutConfig {
+  // In [0, 1].
+  double quantile_;
+  // Fraction added on top of the quantile.
+  double headroom_;
+  std::chrono::milliseconds min_timeout_;
+  // Also the timeout until the first window is complete.
+  std::chrono::milliseconds max_timeout_;
+  uint32_t window_calls_;
+};
+
+/*
+ * Per worker timeout of the sync intercept calls that follows a quantile of their latency. The
+ * latencies of a window of calls are collected in a sketch; when the window is full the timeout
+ * is set to the quantile plus headroom, bounded by the configured minimum and maximum, and the
+ * next window starts. Calls that time out are recorded at their timeout, so a slowing service
+ * raises the timeout window by window. Not thread safe.
+ */
+class AdaptiveTimeout {
+public:
+  AdaptiveTimeout(const AdaptiveTimeoutConfig& config, const AdaptiveTimeoutStatsSharedPtr& stats);
+
+  static AdaptiveTimeoutStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  std::chrono::milliseconds timeout() const { return timeout_; }
+
+  /**
+   * Records the latency of a call that got an answer or timed out.
+   */
+  void onCallComplete(std::chrono::milliseconds latency);
+
+private:
+  const AdaptiveTimeoutConfig config_;
+  AdaptiveTimeoutStatsSharedPtr stats_;
+  LatencySketch window_;
+  std::chrono::milliseconds timeout_;
+};
+
+using AdaptiveTimeoutPtr = std::unique_ptr<AdaptiveTimeout>;
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,96 @@
+#include "mgw-source/filters/common/mgw/mgw_res_batch_encoder.h"
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+// Adds the gzip header and trailer around the deflate stream.
+constexpr int GzipWindowBits = 15 + 16;
+constexpr int MemoryLevel = 8;
+
+} // namespace
+
+ResBatchEncoder::ResBatchEncoder() {
+  // The dictionary already removes most repetition, so the fastest level keeps the CPU cost low.
+  const int result = deflateInit2(&zstream_, Z_BEST_SPEED, Z_DEFLATED, GzipWindowBits,
+                                  MemoryLevel, Z_DEFAULT_STRATEGY);
+  RELEASE_ASSERT(result == Z_OK, "");
+}
+
+ResBatchEncoder::~ResBatchEncoder() { deflateEnd(&zstream_); }
+
+void ResBatchEncoder::encode(const envoy::service::mgw_res::v3::CheckRequestBatch& batch,
+                             envoy::service::mgw_res::v3::BatchEncoding encoding,
+                             envoy::service::mgw_res::v3::CheckRequestBatch& encoded) {
+  ASSERT(encoding != envoy::service::mgw_res::v3::PLAIN);
+  dictionary_batch_.Clear();
+  references_.clear();
+  for (const auto& request : batch.requests()) {
+    auto* compact = dictionary_batch_.add_requests();
+    compact->set_response_code(request.response_code());
+    compact->set_route_name_ref(reference(request.route_name()));
+    compact->set_cluster_name_ref(reference(request.cluster_name()));
+    compact->set_upstream_connect_ns(request.upstream_connect_ns());
+    compact->set_upstream_first_byte_delta_ns(
+        static_cast<int64_t>(request.upstream_first_byte_ns() - request.upstream_connect_ns()));
+    compact->set_upstream_last_byte_delta_ns(
+        static_cast<int64_t>(request.upstream_last_byte_ns() - request.upstream_first_byte_ns()));
+    compact->set_request_bytes(request.request_bytes());
+    compact->set_response_bytes(request.response_bytes());
+    compact->set_response_body(request.response_body());
+    compact->set_response_body_truncated(request.response_body_truncated());
+    compact->set_request_id(request.request_id());
+    for (const auto& header : request.response_headers()) {
+      auto* compact_header = compact->add_response_headers();
+      compact_header->set_name_ref(reference(header.name()));
+      compact_header->set_value_ref(reference(header.value()));
+    }
+  }
+  references_.clear();
+
+  encoded.Clear();
+  encoded.set_encoding(encoding);
+  if (encoding == envoy::service::mgw_res::v3::DICTIONARY) {
+    dictionary_batch_.SerializeToString(encoded.mutable_encoded_requests());
+    return;
+  }
+  dictionary_batch_.SerializeToString(&serialized_);
+  compress(serialized_, *encoded.mutable_encoded_requests());
+}
+
+uint32_t ResBatchEncoder::reference(const std::string& value) {
+  if (value.empty()) {
+    return 0;
+  }
+  const auto result = references_.try_emplace(value, references_.size() + 1);
+  if (result.second) {
+    dictionary_batch_.add_strings(value);
+  }
+  return result.first->second;
+}
+
+void ResBatchEncoder::compress(const std::string& input, std::string& output) {
+  const int reset = deflateReset(&zstream_);
+  RELEASE_ASSERT(reset == Z_OK, "");
+  output.resize(deflateBound(&zstream_, input.size()));
+  zstream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  zstream_.avail_in = input.size();
+  zstream_.next_out = reinterpret_cast<Bytef*>(&output[0]);
+  zstream_.avail_out = output.size();
+  // The output is sized by deflateBound(), so a single call completes the stream.
+  const int result = deflate(&zstream_, Z_FINISH);
+  RELEASE_ASSERT(result == Z_STREAM_END, "");
+  output.resize(zstream_.total_out);
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "zlib.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/*
+ * Turns a plain intercept batch into one of the compact batch encodings. Route and cluster names
+ * and projected headers go into a per batch dictionary and are referenced by index, timings are
+ * stored as differences and the result is optionally gzip compressed. The encoder keeps its
+ * scratch messages and zlib state between batches, so one instance should be reused by a worker.
+ */
+class ResBatchEncoder {
+public:
+  ResBatchEncoder();
+  ~ResBatchEncoder();
+
+  /**
+   * Fills encoded with the requests of batch in the given encoding, which must not be PLAIN.
+   */
+  void encode(const envoy::service::mgw_res::v3::CheckRequestBatch& batch,
+              envoy::service::mgw_res::v3::BatchEncoding encoding,
+              envoy::service::mgw_res::v3::CheckRequestBatch& encoded);
+
+private:
+  // @return the reference of value, adding it to the dictionary if it is new.
+  uint32_t reference(const std::string& value);
+  void compress(const std::string& input, std::string& output);
+
+  envoy::service::mgw_res::v3::DictionaryBatch dictionary_batch_;
+  // Views into the batch being encoded.
+  absl::flat_hash_map<absl::string_view, uint32_t> references_;
+  std::string serialized_;
+  z_stream zstream_{};
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,180 @@
+#include "mgw-source/filters/common/mgw/mgw_res_batcher.h"
+
+#include <algorithm>
+
+#include "common/common/assert.h"
+#include "common/tracing/http_tracer_impl.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+constexpr char InterceptBatchMethod[] = "envoy.service.mgw_res.v3.MGWResponse.InterceptBatch";
+
+const Protobuf::MethodDescriptor& getBatchMethodDescriptor() {
+  const auto* descriptor =
+      Protobuf::DescriptorPool::generated_pool()->FindMethodByName(InterceptBatchMethod);
+  ASSERT(descriptor != nullptr);
+  return *descriptor;
+}
+
+} // namespace
+
+GrpcResBatcherImpl::GrpcResBatcherImpl(Grpc::RawAsyncClientPtr&& async_client,
+                                       const absl::optional<std::chrono::milliseconds>& timeout,
+                                       const ResBatcherConfig& config,
+                                       const ResBatcherStatsSharedPtr& stats,
+                                       Event::Dispatcher& dispatcher, ResSpool* spool)
+    : service_method_(getBatchMethodDescriptor()), async_client_(std::move(async_client)),
+      timeout_(timeout), config_(config), stats_(stats),
+      linger_timer_(dispatcher.createTimer([this]() -> void { flush(FlushReason::MaxLinger); })),
+      spool_(spool) {
+  if (config_.encoding_ != envoy::service::mgw_res::v3::PLAIN) {
+    encoder_ = std::make_unique<ResBatchEncoder>();
+  }
+}
+
+GrpcResBatcherImpl::~GrpcResBatcherImpl() {
+  if (spool_ == nullptr) {
+    return;
+  }
+  // Calls still in flight are reset without calling back, so their requests are spooled here.
+  // Any of them the service already received will be delivered twice.
+  for (const auto& pending : pending_) {
+    spoolBatch(pending->batch_);
+  }
+  spoolBatch(batch_);
+}
+
+ResBatcherStats GrpcResBatcherImpl::generateStats(const std::string& prefix,
+                                                  Stats::Scope& scope) {
+  return {ALL_MGW_RES_BATCHER_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                    POOL_HISTOGRAM_PREFIX(scope, prefix))};
+}
+
+void GrpcResBatcherImpl::publish(const envoy::service::mgw_res::v3::CheckRequest& request) {
+  *batch_.add_requests() = request;
+  batch_bytes_ += request.ByteSizeLong();
+
+  if (static_cast<uint32_t>(batch_.requests_size()) >= config_.max_events_) {
+    flush(FlushReason::MaxEvents);
+  } else if (batch_bytes_ >= config_.max_bytes_) {
+    flush(FlushReason::MaxBytes);
+  } else if (!linger_timer_->enabled()) {
+    linger_timer_->enableTimer(config_.max_linger_);
+  }
+}
+
+void GrpcResBatcherImpl::onSuccess(
+    std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&& response, Tracing::Span&) {
+  if (encoder_ == nullptr) {
+    return;
+  }
+  const auto& accepted = response->accepted_batch_encodings();
+  const bool encoding_accepted =
+      std::find(accepted.begin(), accepted.end(), config_.encoding_) != accepted.end();
+  if (encoding_accepted != encoding_accepted_) {
+    ENVOY_LOG(debug, "mgw intercept batch encoding {} accepted={}",
+              envoy::service::mgw_res::v3::BatchEncoding_Name(config_.encoding_),
+              encoding_accepted);
+    encoding_accepted_ = encoding_accepted;
+  }
+}
+
+void GrpcResBatcherImpl::onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                                   Tracing::Span&) {
+  ENVOY_LOG(debug, "mgw intercept batch failed: status={} message={}", status, message);
+  stats_->send_failure_.inc();
+}
+
+void GrpcResBatcherImpl::PendingBatch::onSuccess(
+    std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&& response, Tracing::Span& span) {
+  parent_.onSuccess(std::move(response), span);
+  parent_.spool_->setReplayEnabled(true);
+  parent_.pending_.erase(self_);
+}
+
+void GrpcResBatcherImpl::PendingBatch::onFailure(Grpc::Status::GrpcStatus status,
+                                                 const std::string& message, Tracing::Span& span) {
+  parent_.onFailure(status, message, span);
+  parent_.spool_->setReplayEnabled(false);
+  parent_.spoolBatch(batch_);
+  parent_.pending_.erase(self_);
+}
+
+void GrpcResBatcherImpl::spoolBatch(const envoy::service::mgw_res::v3::CheckRequestBatch& batch) {
+  for (const auto& request : batch.requests()) {
+    spool_->append(request);
+  }
+}
+
+const envoy::service::mgw_res::v3::CheckRequestBatch&
+GrpcResBatcherImpl::wireBatch(const envoy::service::mgw_res::v3::CheckRequestBatch& batch) {
+  if (!encoding_accepted_) {
+    return batch;
+  }
+  encoder_->encode(batch, config_.encoding_, encoded_batch_);
+  stats_->encoded_.inc();
+  stats_->encoded_bytes_.recordValue(encoded_batch_.encoded_requests().size());
+  return encoded_batch_;
+}
+
+void GrpcResBatcherImpl::flush(FlushReason reason) {
+  linger_timer_->disableTimer();
+  if (batch_.requests_size() == 0) {
+    return;
+  }
+
+  switch (reason) {
+  case FlushReason::MaxEvents:
+    stats_->flushed_max_events_.inc();
+    break;
+  case FlushReason::MaxBytes:
+    stats_->flushed_max_bytes_.inc();
+    break;
+  case FlushReason::MaxLinger:
+    stats_->flushed_max_linger_.inc();
+    break;
+  }
+  stats_->events_.recordValue(batch_.requests_size());
+  stats_->bytes_.recordValue(batch_bytes_);
+
+  if (spool_ != nullptr) {
+    if (pending_.size() >= config_.max_pending_batches_) {
+      // The service is not keeping up. The batch goes to disk rather than into memory, and replay
+      // waits for the next batch that succeeds.
+      stats_->pending_overflow_.inc();
+      spool_->setReplayEnabled(false);
+      spoolBatch(batch_);
+      batch_.Clear();
+      batch_bytes_ = 0;
+      return;
+    }
+    pending_.emplace_front(std::make_unique<PendingBatch>(*this));
+    PendingBatch& pending = *pending_.front();
+    pending.self_ = pending_.begin();
+    pending.batch_.Swap(&batch_);
+    batch_bytes_ = 0;
+    // A failure may be reported inline, which destroys the pending batch before send() returns.
+    async_client_->send(service_method_, wireBatch(pending.batch_), pending,
+                        Tracing::NullSpan::instance(),
+                        Http::AsyncClient::RequestOptions().setTimeout(timeout_));
+    return;
+  }
+
+  // send() serializes the batch before returning, so it can be cleared straight away.
+  async_client_->send(service_method_, wireBatch(batch_), *this, Tracing::NullSpan::instance(),
+                      Http::AsyncClient::RequestOptions().setTimeout(timeout_));
+  batch_.Clear();
+  batch_bytes_ = 0;
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
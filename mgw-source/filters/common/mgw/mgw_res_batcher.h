@@ -0,0 +1,154 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/grpc/async_client.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "common/common/logger.h"
+#include "common/grpc/typed_async_client.h"
+
+#include "mgw-source/filters/common/mgw/mgw.h"
+#include "mgw-source/filters/common/mgw/mgw_res_batch_encoder.h"
+#include "mgw-source/filters/common/mgw/mgw_res_spool.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the intercept batcher. @see stats_macros.h
+ */
+#define ALL_MGW_RES_BATCHER_STATS(COUNTER, HISTOGRAM)                                              \
+  COUNTER(flushed_max_events)                                                                      \
+  COUNTER(flushed_max_bytes)                                                                       \
+  COUNTER(flushed_max_linger)                                                                      \
+  COUNTER(send_failure)                                                                            \
+  COUNTER(pending_overflow)                                                                        \
+  COUNTER(encoded)                                                                                 \
+  HISTOGRAM(events, Unspecified)                                                                   \
+  HISTOGRAM(bytes, Bytes)                                                                          \
+  HISTOGRAM(encoded_bytes, Bytes)
+
+/**
+ * Wrapper struct for intercept batcher stats. @see stats_macros.h
+ */
+struct ResBatcherStats {
+  ALL_MGW_RES_BATCHER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_HISTOGRAM_STRUCT)
+};
+
+using ResBatcherStatsSharedPtr = std::shared_ptr<ResBatcherStats>;
+
+/**
+ * Flush limits of the intercept batcher.
+ */
+struct ResBatcherConfig {
+  uint32_t max_events_;
+  uint32_t max_bytes_;
+  std::chrono::milliseconds max_linger_;
+  // Most batches in flight with a spool, which holds on to them until they complete.
+  uint32_t max_pending_batches_;
+  // Used once the service lists it in a response, batches are sent plain until then.
+  envoy::service::mgw_res::v3::BatchEncoding encoding_;
+};
+
+/*
+ * Per worker publisher that buffers intercept requests and sends them with a single
+ * InterceptBatch call once the batch is full or has waited long enough. It must only be used from
+ * the dispatcher it was created with. Without a spool, failed batches and requests still
+ * buffered when the worker shuts down are dropped. With one, they are written to the spool and
+ * replayed once a batch succeeds again, as are batches flushed while max_pending_batches_ are
+ * still in flight. Spooled requests are always kept plain.
+ */
+class GrpcResBatcherImpl
+    : public ResPublisher,
+      public Grpc::AsyncRequestCallbacks<envoy::service::mgw_res::v3::CheckResponse>,
+      public Logger::Loggable<Logger::Id::filter> {
+public:
+  GrpcResBatcherImpl(Grpc::RawAsyncClientPtr&& async_client,
+                     const absl::optional<std::chrono::milliseconds>& timeout,
+                     const ResBatcherConfig& config, const ResBatcherStatsSharedPtr& stats,
+                     Event::Dispatcher& dispatcher, ResSpool* spool);
+  ~GrpcResBatcherImpl() override;
+
+  static ResBatcherStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  // MGW::ResPublisher
+  void publish(const envoy::service::mgw_res::v3::CheckRequest& request) override;
+
+  // Grpc::AsyncRequestCallbacks
+  void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+  void onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&& response,
+                 Tracing::Span& span) override;
+  void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                 Tracing::Span& span) override;
+
+private:
+  enum class FlushReason { MaxEvents, MaxBytes, MaxLinger };
+
+  /**
+   * A batch sent while a spool is configured. It keeps its requests until the call completes so
+   * they can be spooled if it fails.
+   */
+  struct PendingBatch
+      : public Grpc::AsyncRequestCallbacks<envoy::service::mgw_res::v3::CheckResponse> {
+    explicit PendingBatch(GrpcResBatcherImpl& parent) : parent_(parent) {}
+
+    // Grpc::AsyncRequestCallbacks
+    void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+    void onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&&,
+                   Tracing::Span&) override;
+    void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                   Tracing::Span& span) override;
+
+    GrpcResBatcherImpl& parent_;
+    envoy::service::mgw_res::v3::CheckRequestBatch batch_;
+    std::list<std::unique_ptr<PendingBatch>>::iterator self_;
+  };
+  using PendingBatchPtr = std::unique_ptr<PendingBatch>;
+
+  void flush(FlushReason reason);
+  void spoolBatch(const envoy::service::mgw_res::v3::CheckRequestBatch& batch);
+  // @return batch, or its encoding if the service accepts the configured one.
+  const envoy::service::mgw_res::v3::CheckRequestBatch&
+  wireBatch(const envoy::service::mgw_res::v3::CheckRequestBatch& batch);
+
+  const Protobuf::MethodDescriptor& service_method_;
+  Grpc::AsyncClient<envoy::service::mgw_res::v3::CheckRequestBatch,
+                    envoy::service::mgw_res::v3::CheckResponse>
+      async_client_;
+  const absl::optional<std::chrono::milliseconds> timeout_;
+  const ResBatcherConfig config_;
+  ResBatcherStatsSharedPtr stats_;
+  Event::TimerPtr linger_timer_;
+  // The batch is cleared rather than reallocated after each flush, so the repeated field keeps
+  // its elements around for reuse.
+  envoy::service::mgw_res::v3::CheckRequestBatch batch_;
+  uint64_t batch_bytes_{};
+  // Not owned. Null unless spooling is configured.
+  ResSpool* spool_;
+  // At most config_.max_pending_batches_.
+  std::list<PendingBatchPtr> pending_;
+  // Null if the configured encoding is PLAIN.
+  std::unique_ptr<ResBatchEncoder> encoder_;
+  // Set by each successful response, so the service can also stop accepting the encoding.
+  bool encoding_accepted_{};
+  // Reused for the encoded form of each batch. send() serializes it before returning.
+  envoy::service::mgw_res::v3::CheckRequestBatch encoded_batch_;
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,14 +1,18 @@
 #include "mgw-source/filters/common/mgw/mgw_res_grpc_impl.h"
 
+#include <cstddef>
+
 #include "envoy/config/core/v3/base.pb.h"
 #include "mgw-api/services/response/v3/mgw_res.pb.h"
 
 #include "common/common/assert.h"
 #include "common/grpc/async_client_impl.h"
+#include "common/grpc/common.h"
 #include "common/http/headers.h"
 #include "common/http/utility.h"
 #include "common/network/utility.h"
 #include "common/protobuf/protobuf.h"
+#include "common/tracing/http_tracer_impl.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -19,9 +23,17 @@ namespace MGW {
 // selecting service path.
 constexpr char V2[] = "envoy.service.mgw_res.v3.MGWResponse.Intercept";
 
-GrpcResClientImpl::GrpcResClientImpl(Grpc::RawAsyncClientPtr&& async_client,
+namespace {
+
+// Room for a CheckResponse with a short status message. Larger answers spill into blocks the
+// arena allocates.
+constexpr size_t ResponseArenaBytes = 512;
+
+} // namespace
+
+GrpcResClientImpl::GrpcResClientImpl(const Grpc::RawAsyncClientSharedPtr& async_client,
                                const absl::optional<std::chrono::milliseconds>& timeout)
-    : service_method_(getMethodDescriptor()), async_client_(std::move(async_client)),
+    : service_method_(getMethodDescriptor()), async_client_(async_client),
       timeout_(timeout) {}
 
 GrpcResClientImpl::~GrpcResClientImpl() { ASSERT(!callbacks_); }
@@ -37,17 +49,36 @@ void GrpcResClientImpl::intercept(ResponseCallbacks& callbacks,
                                   Tracing::Span& parent_span, const StreamInfo::StreamInfo&) {
   ASSERT(callbacks_ == nullptr);
   callbacks_ = &callbacks;
-  std::cout << "response 40" << std::endl;
   request_ = async_client_->send(service_method_, request, *this, parent_span,
                                  Http::AsyncClient::RequestOptions().setTimeout(timeout_));
-  std::cout << "response 43" << std::endl;
+}
+
+void GrpcResClientImpl::onSuccessRaw(Buffer::InstancePtr&& response, Tracing::Span& span) {
+  // The typed client would decode into a new heap message. The answer is only needed until the
+  // callback returns, so it is decoded into an arena whose first block is on the stack.
+  alignas(alignof(std::max_align_t)) char initial_block[ResponseArenaBytes];
+  Protobuf::ArenaOptions options;
+  options.initial_block = initial_block;
+  options.initial_block_size = sizeof(initial_block);
+  Protobuf::Arena arena(options);
+  auto* message =
+      Protobuf::Arena::CreateMessage<envoy::service::mgw_res::v3::CheckResponse>(&arena);
+  if (!Grpc::Common::parseBufferInstance(std::move(response), *message)) {
+    onFailure(Grpc::Status::WellKnownGrpcStatus::Internal, "", span);
+    return;
+  }
+  onResponse(*message, span);
 }
 
 void GrpcResClientImpl::onSuccess(
     std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&& response, Tracing::Span& span) {
-  std::cout << "response 47" << std::endl;
-  ResponsePtr mgw_response = std::make_unique<Response>(Response{});
-  if (response->status().code() == Grpc::Status::WellKnownGrpcStatus::Ok) {
+  onResponse(*response, span);
+}
+
+void GrpcResClientImpl::onResponse(const envoy::service::mgw_res::v3::CheckResponse& response,
+                                   Tracing::Span& span) {
+  ResponsePtr mgw_response = createResponse();
+  if (response.status().code() == Grpc::Status::WellKnownGrpcStatus::Ok) {
     span.setTag(TracingConstants::get().TraceStatus, TracingConstants::get().TraceOk);
     mgw_response->status = CheckStatus::OK;
   } else {
@@ -62,11 +93,10 @@ void GrpcResClientImpl::onSuccess(
 void GrpcResClientImpl::onFailure(Grpc::Status::GrpcStatus status, const std::string&,
                                Tracing::Span&) {
   ASSERT(status != Grpc::Status::WellKnownGrpcStatus::Ok);
-  Response response{};
-  response.status = CheckStatus::Error;
-  response.status_code = Http::Code::Forbidden;
-  std::cout << "response 78" << std::endl;
-  callbacks_->onResponseComplete(std::make_unique<Response>(response));
+  ResponsePtr response = createResponse();
+  response->status = CheckStatus::Error;
+  response->status_code = Http::Code::Forbidden;
+  callbacks_->onResponseComplete(std::move(response));
   callbacks_ = nullptr;
 }
 
@@ -85,6 +115,45 @@ void GrpcResClientImpl::toAuthzResponseHeader(
   }
 }
 
+GrpcResPublisherImpl::GrpcResPublisherImpl(
+    Grpc::RawAsyncClientPtr&& async_client,
+    const absl::optional<std::chrono::milliseconds>& timeout, uint32_t max_pending,
+    const ResPublisherStatsSharedPtr& stats)
+    : service_method_(GrpcResClientImpl::getMethodDescriptor()),
+      async_client_(std::move(async_client)), timeout_(timeout), max_pending_(max_pending),
+      stats_(stats) {}
+
+ResPublisherStats GrpcResPublisherImpl::generateStats(const std::string& prefix,
+                                                      Stats::Scope& scope) {
+  return {ALL_MGW_RES_PUBLISHER_STATS(POOL_COUNTER_PREFIX(scope, prefix))};
+}
+
+void GrpcResPublisherImpl::publish(const envoy::service::mgw_res::v3::CheckRequest& request) {
+  if (pending_ >= max_pending_) {
+    stats_->publish_dropped_.inc();
+    return;
+  }
+  // Counted first, a call that fails inline has already completed when send() returns.
+  pending_++;
+  // The request is serialized inside send(), so the caller is free to reuse it once we return.
+  async_client_->send(service_method_, request, *this, Tracing::NullSpan::instance(),
+                      Http::AsyncClient::RequestOptions().setTimeout(timeout_));
+}
+
+void GrpcResPublisherImpl::onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&&,
+                                     Tracing::Span&) {
+  ASSERT(pending_ > 0);
+  pending_--;
+}
+
+void GrpcResPublisherImpl::onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                                     Tracing::Span&) {
+  ASSERT(pending_ > 0);
+  pending_--;
+  ENVOY_LOG(debug, "mgw intercept publish failed with status {}: {}", status, message);
+  stats_->publish_failed_.inc();
+}
+
 const Protobuf::MethodDescriptor& GrpcResClientImpl::getMethodDescriptor() {
   const auto* descriptor = Protobuf::DescriptorPool::generated_pool()->FindMethodByName(V2);
   ASSERT(descriptor != nullptr);
@@ -15,9 +15,12 @@
 #include "envoy/network/connection.h"
 #include "envoy/network/filter.h"
 #include "mgw-api/services/response/v3/mgw_res.pb.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
 #include "envoy/tracing/http_tracer.h"
 #include "envoy/upstream/cluster_manager.h"
 
+#include "common/common/logger.h"
 #include "common/grpc/typed_async_client.h"
 
 #include "mgw-source/filters/common/mgw/mgw.h"
@@ -34,12 +37,12 @@ using MGWAsyncResCallbacks = Grpc::AsyncRequestCallbacks<envoy::service::mgw_res
  * This client implementation is used when the mgw filter needs to communicate with an gRPC
  * mgw response filter server. Unlike the HTTP client, the gRPC allows the server to define response
  * objects which contain the HTTP attributes to be sent to the the downstream client.
- * The gRPC client does not rewrite path. NOTE: We create gRPC client for each filter stack instead
- * of a client per thread. That is ok since this is unary RPC and the cost of doing this is minimal.
+ * The gRPC client does not rewrite path. NOTE: This object is created for each filter stack, but
+ * the underlying async client is shared by all the streams of a worker.
  */
 class GrpcResClientImpl : public ResClient, public MGWAsyncResCallbacks {
 public:
-  GrpcResClientImpl(Grpc::RawAsyncClientPtr&& async_client,
+  GrpcResClientImpl(const Grpc::RawAsyncClientSharedPtr& async_client,
                  const absl::optional<std::chrono::milliseconds>& timeout);
   ~GrpcResClientImpl() override;
 
@@ -49,6 +52,9 @@ public:
                  const envoy::service::mgw_res::v3::CheckRequest& request,
                  Tracing::Span& parent_span, const StreamInfo::StreamInfo& stream_info) override;
 
+  // Grpc::RawAsyncRequestCallbacks
+  void onSuccessRaw(Buffer::InstancePtr&& response, Tracing::Span& span) override;
+
   // Grpc::AsyncRequestCallbacks
   void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
   void onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&& response,
@@ -56,8 +62,11 @@ public:
   void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
                  Tracing::Span& span) override;
 
-private:
   static const Protobuf::MethodDescriptor& getMethodDescriptor();
+
+private:
+  void onResponse(const envoy::service::mgw_res::v3::CheckResponse& response,
+                  Tracing::Span& span);
   void toAuthzResponseHeader(
       ResponsePtr& response,
       const Protobuf::RepeatedPtrField<envoy::config::core::v3::HeaderValueOption>& headers);
@@ -72,6 +81,60 @@ private:
   ResponseCallbacks* callbacks_{};
 };
 
+/**
+ * All stats for the per request async publisher. @see stats_macros.h
+ */
+#define ALL_MGW_RES_PUBLISHER_STATS(COUNTER)                                                       \
+  COUNTER(publish_dropped)                                                                         \
+  COUNTER(publish_failed)
+
+/**
+ * Wrapper struct for per request async publisher stats. @see stats_macros.h
+ */
+struct ResPublisherStats {
+  ALL_MGW_RES_PUBLISHER_STATS(GENERATE_COUNTER_STRUCT)
+};
+
+using ResPublisherStatsSharedPtr = std::shared_ptr<ResPublisherStats>;
+
+/*
+ * Publisher used by the mgw filter in async mode. One instance lives on each worker and owns its
+ * own async client, so in-flight calls belong to the worker rather than to the HTTP stream that
+ * produced them. Replies are discarded. At most max_pending calls are in flight; requests beyond
+ * that are dropped and counted, so a slow service cannot make the worker's memory grow without
+ * bound.
+ */
+class GrpcResPublisherImpl : public ResPublisher,
+                             public MGWAsyncResCallbacks,
+                             public Logger::Loggable<Logger::Id::filter> {
+public:
+  GrpcResPublisherImpl(Grpc::RawAsyncClientPtr&& async_client,
+                       const absl::optional<std::chrono::milliseconds>& timeout,
+                       uint32_t max_pending, const ResPublisherStatsSharedPtr& stats);
+
+  static ResPublisherStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  // MGW::ResPublisher
+  void publish(const envoy::service::mgw_res::v3::CheckRequest& request) override;
+
+  // Grpc::AsyncRequestCallbacks
+  void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+  void onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&&,
+                 Tracing::Span&) override;
+  void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                 Tracing::Span&) override;
+
+private:
+  const Protobuf::MethodDescriptor& service_method_;
+  Grpc::AsyncClient<envoy::service::mgw_res::v3::CheckRequest,
+                    envoy::service::mgw_res::v3::CheckResponse>
+      async_client_;
+  absl::optional<std::chrono::milliseconds> timeout_;
+  const uint32_t max_pending_;
+  ResPublisherStatsSharedPtr stats_;
+  uint32_t pending_{};
+};
+
 } // namespace MGW
 } // namespace Common
 } // namespace Filters
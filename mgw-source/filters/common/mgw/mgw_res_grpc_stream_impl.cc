@@ -0,0 +1,158 @@
+#include "mgw-source/filters/common/mgw/mgw_res_grpc_stream_impl.h"
+
+#include "common/common/assert.h"
+#include "common/common/backoff_strategy.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+constexpr char InterceptStreamMethod[] = "envoy.service.mgw_res.v3.MGWResponse.InterceptStream";
+
+// How often a stream above its high watermark is checked for having drained.
+constexpr std::chrono::milliseconds DrainCheckInterval{100};
+
+const Protobuf::MethodDescriptor& getStreamMethodDescriptor() {
+  const auto* descriptor =
+      Protobuf::DescriptorPool::generated_pool()->FindMethodByName(InterceptStreamMethod);
+  ASSERT(descriptor != nullptr);
+  return *descriptor;
+}
+
+} // namespace
+
+GrpcResStreamImpl::GrpcResStreamImpl(Grpc::RawAsyncClientPtr&& async_client,
+                                     const ResStreamConfig& config,
+                                     const ResStreamStatsSharedPtr& stats,
+                                     Event::Dispatcher& dispatcher,
+                                     Runtime::RandomGenerator& random, ResSpool* spool)
+    : service_method_(getStreamMethodDescriptor()), async_client_(std::move(async_client)),
+      stats_(stats),
+      backoff_strategy_(std::make_unique<JitteredBackOffStrategy>(
+          config.base_reconnect_interval_.count(), config.max_reconnect_interval_.count(),
+          random)),
+      reconnect_timer_(dispatcher.createTimer([this]() -> void { establishStream(); })),
+      drain_timer_(dispatcher.createTimer([this]() -> void { checkDrained(); })), spool_(spool) {}
+
+GrpcResStreamImpl::~GrpcResStreamImpl() {
+  if (stream_ != nullptr) {
+    // Resetting does not call back into us, unlike a graceful close.
+    stats_->connected_.dec();
+    stream_.resetStream();
+  }
+}
+
+ResStreamStats GrpcResStreamImpl::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_MGW_RES_STREAM_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                   POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+void GrpcResStreamImpl::publish(const envoy::service::mgw_res::v3::CheckRequest& request) {
+  if (stream_ == nullptr && !reconnect_timer_->enabled()) {
+    // Not backing off, so this is either the first request or the server closed cleanly.
+    establishStream();
+  }
+  if (stream_ == nullptr || stream_.isAboveWriteBufferHighWatermark()) {
+    if (spool_ != nullptr) {
+      if (stream_ != nullptr) {
+        pauseReplay();
+      }
+      spool_->append(request);
+    } else if (stream_ == nullptr) {
+      stats_->events_dropped_disconnected_.inc();
+    } else {
+      stats_->events_dropped_overflow_.inc();
+    }
+    return;
+  }
+
+  stream_.sendMessage(request, false);
+  stats_->events_sent_.inc();
+}
+
+void GrpcResStreamImpl::onReceiveInitialMetadata(Http::ResponseHeaderMapPtr&&) {
+  // The server accepted the stream.
+  backoff_strategy_->reset();
+  if (spool_ != nullptr) {
+    spool_->setReplayEnabled(true);
+  }
+}
+
+void GrpcResStreamImpl::onRemoteClose(Grpc::Status::GrpcStatus status,
+                                      const std::string& message) {
+  if (stream_ == nullptr) {
+    // start() failed inline. establishStream() handles that once start() returns.
+    return;
+  }
+
+  ENVOY_LOG(debug, "mgw intercept stream closed: status={} message={}", status, message);
+  stream_ = nullptr;
+  stats_->connected_.dec();
+  // The buffer went with the stream, whether replay resumes is up to the close status now.
+  drain_timer_->disableTimer();
+  replay_paused_ = false;
+  if (status == Grpc::Status::WellKnownGrpcStatus::Ok) {
+    // A clean close is the server rotating streams. Reopen on the next request.
+    stats_->stream_closed_.inc();
+    backoff_strategy_->reset();
+    if (spool_ != nullptr) {
+      spool_->setReplayEnabled(true);
+    }
+    return;
+  }
+
+  stats_->stream_failure_.inc();
+  if (spool_ != nullptr) {
+    spool_->setReplayEnabled(false);
+  }
+  scheduleReconnect();
+}
+
+void GrpcResStreamImpl::establishStream() {
+  ASSERT(stream_ == nullptr);
+  stream_ = async_client_->start(service_method_, *this, Http::AsyncClient::StreamOptions());
+  if (stream_ == nullptr) {
+    ENVOY_LOG(debug, "mgw intercept stream could not be started");
+    stats_->stream_failure_.inc();
+    scheduleReconnect();
+    return;
+  }
+
+  stats_->stream_opened_.inc();
+  stats_->connected_.inc();
+}
+
+void GrpcResStreamImpl::pauseReplay() {
+  if (replay_paused_) {
+    return;
+  }
+  // Replayed requests would only be spooled again behind the full buffer.
+  replay_paused_ = true;
+  spool_->setReplayEnabled(false);
+  drain_timer_->enableTimer(DrainCheckInterval);
+}
+
+void GrpcResStreamImpl::checkDrained() {
+  ASSERT(replay_paused_ && stream_ != nullptr);
+  // The stream stays above the high watermark until its buffer drains to the low watermark.
+  if (stream_.isAboveWriteBufferHighWatermark()) {
+    drain_timer_->enableTimer(DrainCheckInterval);
+    return;
+  }
+  replay_paused_ = false;
+  spool_->setReplayEnabled(true);
+}
+
+void GrpcResStreamImpl::scheduleReconnect() {
+  reconnect_timer_->enableTimer(std::chrono::milliseconds(backoff_strategy_->nextBackOffMs()));
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "envoy/common/backoff_strategy.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/grpc/async_client.h"
+#include "envoy/runtime/runtime.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "common/common/logger.h"
+#include "common/grpc/typed_async_client.h"
+
+#include "mgw-source/filters/common/mgw/mgw.h"
+#include "mgw-source/filters/common/mgw/mgw_res_spool.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the intercept stream. @see stats_macros.h
+ */
+#define ALL_MGW_RES_STREAM_STATS(COUNTER, GAUGE)                                                   \
+  COUNTER(events_sent)                                                                             \
+  COUNTER(events_dropped_disconnected)                                                             \
+  COUNTER(events_dropped_overflow)                                                                 \
+  COUNTER(stream_opened)                                                                           \
+  COUNTER(stream_closed)                                                                           \
+  COUNTER(stream_failure)                                                                          \
+  GAUGE(connected, Accumulate)
+
+/**
+ * Wrapper struct for intercept stream stats. @see stats_macros.h
+ */
+struct ResStreamStats {
+  ALL_MGW_RES_STREAM_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+using ResStreamStatsSharedPtr = std::shared_ptr<ResStreamStats>;
+
+/**
+ * Reconnect settings of the intercept stream.
+ */
+struct ResStreamConfig {
+  std::chrono::milliseconds base_reconnect_interval_;
+  std::chrono::milliseconds max_reconnect_interval_;
+};
+
+/*
+ * Per worker publisher that writes intercept requests onto one long-lived InterceptStream. The
+ * stream is opened on first use and reopened with jittered backoff after a failure. Requests
+ * never wait for the stream: while it is down or above its write buffer high watermark they are
+ * dropped and counted, or written to the spool if one is configured. Spooled requests are
+ * replayed once the server accepts a stream again, which it signals by sending initial metadata
+ * or closing a stream cleanly. Replay pauses while the stream is above its high watermark and
+ * resumes once it has drained to the low watermark. It must only be used from the dispatcher it
+ * was created with.
+ */
+class GrpcResStreamImpl
+    : public ResPublisher,
+      public Grpc::AsyncStreamCallbacks<envoy::service::mgw_res::v3::CheckResponse>,
+      public Logger::Loggable<Logger::Id::filter> {
+public:
+  GrpcResStreamImpl(Grpc::RawAsyncClientPtr&& async_client, const ResStreamConfig& config,
+                    const ResStreamStatsSharedPtr& stats, Event::Dispatcher& dispatcher,
+                    Runtime::RandomGenerator& random, ResSpool* spool);
+  ~GrpcResStreamImpl() override;
+
+  static ResStreamStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  // MGW::ResPublisher
+  void publish(const envoy::service::mgw_res::v3::CheckRequest& request) override;
+
+  // Grpc::AsyncStreamCallbacks
+  void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+  void onReceiveInitialMetadata(Http::ResponseHeaderMapPtr&&) override;
+  void onReceiveMessage(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&&) override {}
+  void onReceiveTrailingMetadata(Http::ResponseTrailerMapPtr&&) override {}
+  void onRemoteClose(Grpc::Status::GrpcStatus status, const std::string& message) override;
+
+private:
+  // Tries to open the stream. Schedules a reconnect if the client refuses to start one.
+  void establishStream();
+  void scheduleReconnect();
+  // Stops spool replay until the stream buffer drains. Only called with a spool.
+  void pauseReplay();
+  void checkDrained();
+
+  const Protobuf::MethodDescriptor& service_method_;
+  Grpc::AsyncClient<envoy::service::mgw_res::v3::CheckRequest,
+                    envoy::service::mgw_res::v3::CheckResponse>
+      async_client_;
+  Grpc::AsyncStream<envoy::service::mgw_res::v3::CheckRequest> stream_{};
+  ResStreamStatsSharedPtr stats_;
+  BackOffStrategyPtr backoff_strategy_;
+  Event::TimerPtr reconnect_timer_;
+  // Polls the write buffer while replay is paused, the stream reports no watermark callbacks.
+  Event::TimerPtr drain_timer_;
+  bool replay_paused_{};
+  // Not owned. Null unless spooling is configured.
+  ResSpool* spool_;
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
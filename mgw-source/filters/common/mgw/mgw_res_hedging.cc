@@ -0,0 +1,195 @@
+#include "mgw-source/filters/common/mgw/mgw_res_hedging.h"
+
+#include <algorithm>
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+// Most hedges that can be saved up, so that a quiet period does not allow a burst of hedges.
+constexpr double MaxHedgeTokens = 10;
+// Step size of the p95 estimate. Above the estimate it moves up by 0.95 * step, below it moves
+// down by 0.05 * step, which settles where 5% of the answers are slower.
+constexpr double P95Step = 0.1;
+
+} // namespace
+
+ResHedgePolicy::ResHedgePolicy(const ResHedgeConfig& config, const ResHedgeStatsSharedPtr& stats,
+                               Event::Dispatcher& dispatcher)
+    : config_(config), stats_(stats), dispatcher_(dispatcher) {}
+
+ResHedgeStats ResHedgePolicy::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_MGW_RES_HEDGE_STATS(POOL_COUNTER_PREFIX(scope, prefix))};
+}
+
+void ResHedgePolicy::onCall() { tokens_ = std::min(MaxHedgeTokens, tokens_ + config_.budget_); }
+
+absl::optional<std::chrono::milliseconds> ResHedgePolicy::hedgeDelay() const {
+  if (config_.delay_.has_value()) {
+    return config_.delay_;
+  }
+  if (p95_ms_ == 0) {
+    return absl::nullopt;
+  }
+  return std::chrono::milliseconds(std::max<int64_t>(1, static_cast<int64_t>(p95_ms_)));
+}
+
+bool ResHedgePolicy::tryHedge() {
+  if (tokens_ < 1) {
+    stats_->budget_exhausted_.inc();
+    return false;
+  }
+  tokens_ -= 1;
+  return true;
+}
+
+void ResHedgePolicy::recordLatency(std::chrono::milliseconds latency) {
+  const double sample = std::max<double>(1, latency.count());
+  if (p95_ms_ == 0) {
+    p95_ms_ = sample;
+  } else if (sample > p95_ms_) {
+    p95_ms_ *= 1 + 0.95 * P95Step;
+  } else {
+    p95_ms_ *= 1 - 0.05 * P95Step;
+  }
+}
+
+HedgedGrpcResClientImpl::HedgedGrpcResClientImpl(
+    const Grpc::RawAsyncClientSharedPtr& async_client,
+    const absl::optional<std::chrono::milliseconds>& timeout, ResHedgePolicy& policy,
+    CallLimiter* limiter)
+    : async_client_(async_client), timeout_(timeout), policy_(policy), limiter_(limiter),
+      primary_(*this), hedge_(*this) {}
+
+HedgedGrpcResClientImpl::~HedgedGrpcResClientImpl() { ASSERT(!callbacks_); }
+
+void HedgedGrpcResClientImpl::cancel() {
+  ASSERT(callbacks_ != nullptr);
+  callbacks_ = nullptr;
+  if (hedge_timer_ != nullptr) {
+    hedge_timer_->disableTimer();
+  }
+  for (Attempt* attempt : {&primary_, &hedge_}) {
+    if (attempt->active_) {
+      cancelAttempt(*attempt);
+    }
+  }
+}
+
+void HedgedGrpcResClientImpl::intercept(ResponseCallbacks& callbacks,
+                                        const envoy::service::mgw_res::v3::CheckRequest& request,
+                                        Tracing::Span& parent_span,
+                                        const StreamInfo::StreamInfo& stream_info) {
+  ASSERT(callbacks_ == nullptr);
+  callbacks_ = &callbacks;
+  request_ = &request;
+  parent_span_ = &parent_span;
+  stream_info_ = &stream_info;
+  policy_.onCall();
+
+  start(primary_, timeout_);
+  if (callbacks_ == nullptr) {
+    // Answered inline.
+    return;
+  }
+  const absl::optional<std::chrono::milliseconds> delay = policy_.hedgeDelay();
+  if (!delay.has_value()) {
+    return;
+  }
+  if (hedge_timer_ == nullptr) {
+    hedge_timer_ = policy_.dispatcher().createTimer([this]() -> void { onHedgeTimer(); });
+  }
+  hedge_timer_->enableTimer(delay.value());
+}
+
+void HedgedGrpcResClientImpl::start(Attempt& attempt,
+                                    const absl::optional<std::chrono::milliseconds>& timeout) {
+  attempt.active_ = true;
+  attempt.start_ = policy_.dispatcher().timeSource().monotonicTime();
+  attempt.client_.emplace(async_client_, timeout);
+  attempt.client_->intercept(attempt, *request_, *parent_span_, *stream_info_);
+}
+
+void HedgedGrpcResClientImpl::cancelAttempt(Attempt& attempt) {
+  attempt.active_ = false;
+  attempt.client_->cancel();
+  if (&attempt == &hedge_ && limiter_ != nullptr) {
+    limiter_->onCallCancelled(hedge_admission_);
+  }
+}
+
+void HedgedGrpcResClientImpl::onHedgeTimer() {
+  ASSERT(callbacks_ != nullptr && primary_.active_);
+  // The hedge only gets what is left of the caller's timeout.
+  absl::optional<std::chrono::milliseconds> timeout;
+  if (timeout_.has_value()) {
+    const std::chrono::milliseconds elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        policy_.dispatcher().timeSource().monotonicTime() - primary_.start_);
+    if (elapsed >= timeout_.value()) {
+      // The primary is about to time out, and a hedge could not end any sooner.
+      return;
+    }
+    timeout = timeout_.value() - elapsed;
+  }
+  if (limiter_ != nullptr) {
+    // The hedge is load on the service too. Rejections are counted by the limiter.
+    hedge_admission_ = limiter_->tryAdmit();
+    if (hedge_admission_ == CallLimiter::Admission::Rejected) {
+      return;
+    }
+  }
+  if (!policy_.tryHedge()) {
+    if (limiter_ != nullptr) {
+      limiter_->onCallCancelled(hedge_admission_);
+    }
+    return;
+  }
+  policy_.stats().hedges_sent_.inc();
+  start(hedge_, timeout);
+}
+
+void HedgedGrpcResClientImpl::onAttemptComplete(Attempt& attempt, ResponsePtr&& response) {
+  attempt.active_ = false;
+  const std::chrono::milliseconds latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+      policy_.dispatcher().timeSource().monotonicTime() - attempt.start_);
+  if (&attempt == &hedge_ && limiter_ != nullptr) {
+    limiter_->onCallComplete(hedge_admission_, latency, response->status == CheckStatus::Error);
+  }
+  Attempt& other = &attempt == &primary_ ? hedge_ : primary_;
+  if (response->status == CheckStatus::Error && other.active_) {
+    // The other call may still get through.
+    return;
+  }
+
+  if (hedge_timer_ != nullptr) {
+    hedge_timer_->disableTimer();
+  }
+  if (other.active_) {
+    cancelAttempt(other);
+  }
+  if (&attempt == &hedge_) {
+    policy_.stats().hedges_won_.inc();
+  }
+  if (response->status != CheckStatus::Error) {
+    // From the start of the primary, which is how long the caller waited. A hedge that wins would
+    // otherwise look fast and make hedging ever more eager.
+    policy_.recordLatency(std::chrono::duration_cast<std::chrono::milliseconds>(
+        policy_.dispatcher().timeSource().monotonicTime() - primary_.start_));
+  }
+
+  ResponseCallbacks* callbacks = callbacks_;
+  callbacks_ = nullptr;
+  callbacks->onResponseComplete(std::move(response));
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
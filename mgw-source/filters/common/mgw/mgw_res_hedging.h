@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/grpc/async_client.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "absl/types/optional.h"
+#include "mgw-source/filters/common/mgw/mgw.h"
+#include "mgw-source/filters/common/mgw/mgw_call_limiter.h"
+#include "mgw-source/filters/common/mgw/mgw_res_grpc_impl.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for intercept call hedging. @see stats_macros.h
+ */
+#define ALL_MGW_RES_HEDGE_STATS(COUNTER)                                                           \
+  COUNTER(hedges_sent)                                                                             \
+  COUNTER(hedges_won)                                                                              \
+  COUNTER(budget_exhausted)
+
+/**
+ * Wrapper struct for intercept call hedging stats. @see stats_macros.h
+ */
+struct ResHedgeStats {
+  ALL_MGW_RES_HEDGE_STATS(GENERATE_COUNTER_STRUCT)
+};
+
+using ResHedgeStatsSharedPtr = std::shared_ptr<ResHedgeStats>;
+
+/**
+ * Hedging settings.
+ */
+struct ResHedgeConfig {
+  // Fixed hedge delay. When unset the observed p95 is used.
+  absl::optional<std::chrono::milliseconds> delay_;
+  // Largest share of calls that may be hedged, in [0, 1].
+  double budget_;
+};
+
+/**
+ * Per worker hedging state: when to hedge, and whether the budget still allows it. Not thread
+ * safe.
+ */
+class ResHedgePolicy {
+public:
+  ResHedgePolicy(const ResHedgeConfig& config, const ResHedgeStatsSharedPtr& stats,
+                 Event::Dispatcher& dispatcher);
+
+  static ResHedgeStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  /**
+   * Called once per call. Earns the budget for hedges.
+   */
+  void onCall();
+
+  /**
+   * @return the delay after which a call should be hedged, or nullopt if no delay is known yet.
+   */
+  absl::optional<std::chrono::milliseconds> hedgeDelay() const;
+
+  /**
+   * Takes one hedge from the budget.
+   * @return false if the budget is used up. Counted.
+   */
+  bool tryHedge();
+
+  /**
+   * Feeds the latency of an answered call into the p95 estimate.
+   */
+  void recordLatency(std::chrono::milliseconds latency);
+
+  Event::Dispatcher& dispatcher() { return dispatcher_; }
+  ResHedgeStats& stats() { return *stats_; }
+
+private:
+  const ResHedgeConfig config_;
+  ResHedgeStatsSharedPtr stats_;
+  Event::Dispatcher& dispatcher_;
+  // Hedges that may be sent now. Each call adds budget_, so at most that share of calls is hedged
+  // over time.
+  double tokens_{};
+  // Running p95 estimate in milliseconds, 0 until the first answer.
+  double p95_ms_{};
+};
+
+using ResHedgePolicyPtr = std::unique_ptr<ResHedgePolicy>;
+
+/*
+ * Sync mode client that hedges: it makes the call through one GrpcResClientImpl and, if there is
+ * no answer after the policy's delay, makes it again through a second one. The first answer is
+ * delivered and the other call cancelled. A failure is only delivered once neither call can
+ * still succeed. The hedge gets what is left of the timeout, so the call as a whole still ends
+ * within it. The hedge is admitted by the call limiter, if there is one, like any other call;
+ * the caller admits the first call. Created for each filter stack like GrpcResClientImpl.
+ */
+class HedgedGrpcResClientImpl : public ResClient {
+public:
+  HedgedGrpcResClientImpl(const Grpc::RawAsyncClientSharedPtr& async_client,
+                          const absl::optional<std::chrono::milliseconds>& timeout,
+                          ResHedgePolicy& policy, CallLimiter* limiter);
+  ~HedgedGrpcResClientImpl() override;
+
+  // MGW::ResClient
+  void cancel() override;
+  void intercept(ResponseCallbacks& callbacks,
+                 const envoy::service::mgw_res::v3::CheckRequest& request,
+                 Tracing::Span& parent_span, const StreamInfo::StreamInfo& stream_info) override;
+
+private:
+  // One of the two calls.
+  struct Attempt : public ResponseCallbacks {
+    Attempt(HedgedGrpcResClientImpl& parent) : parent_(parent) {}
+
+    // MGW::ResponseCallbacks
+    void onResponseComplete(ResponsePtr&& response) override {
+      parent_.onAttemptComplete(*this, std::move(response));
+    }
+
+    HedgedGrpcResClientImpl& parent_;
+    // Made when the attempt starts, with the timeout it has left.
+    absl::optional<GrpcResClientImpl> client_;
+    bool active_{};
+    MonotonicTime start_;
+  };
+
+  void start(Attempt& attempt, const absl::optional<std::chrono::milliseconds>& timeout);
+  void cancelAttempt(Attempt& attempt);
+  void onHedgeTimer();
+  void onAttemptComplete(Attempt& attempt, ResponsePtr&& response);
+
+  const Grpc::RawAsyncClientSharedPtr async_client_;
+  // Of the call as a whole, from the start of the primary.
+  const absl::optional<std::chrono::milliseconds> timeout_;
+  ResHedgePolicy& policy_;
+  // May be null.
+  CallLimiter* limiter_;
+  // How the limiter let the hedge through.
+  CallLimiter::Admission hedge_admission_{CallLimiter::Admission::Rejected};
+  Attempt primary_;
+  Attempt hedge_;
+  Event::TimerPtr hedge_timer_;
+  ResponseCallbacks* callbacks_{};
+  // Valid while a call is in flight; the filter keeps them alive until it is answered or
+  // cancelled.
+  const envoy::service::mgw_res::v3::CheckRequest* request_{};
+  Tracing::Span* parent_span_{};
+  const StreamInfo::StreamInfo* stream_info_{};
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
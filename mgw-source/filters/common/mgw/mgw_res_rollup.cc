@@ -0,0 +1,107 @@
+#include "mgw-source/filters/common/mgw/mgw_res_rollup.h"
+
+#include "common/common/assert.h"
+#include "common/tracing/http_tracer_impl.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+constexpr char InterceptRollupMethod[] = "envoy.service.mgw_res.v3.MGWResponse.InterceptRollup";
+
+const Protobuf::MethodDescriptor& getRollupMethodDescriptor() {
+  const auto* descriptor =
+      Protobuf::DescriptorPool::generated_pool()->FindMethodByName(InterceptRollupMethod);
+  ASSERT(descriptor != nullptr);
+  return *descriptor;
+}
+
+} // namespace
+
+void ResRollups::record(absl::string_view route_name, absl::string_view cluster_name,
+                        uint32_t status_class, uint64_t request_bytes, uint64_t response_bytes,
+                        uint64_t latency_ns) {
+  auto it = rollups_.find(KeyView{route_name, cluster_name, status_class});
+  if (it == rollups_.end()) {
+    it = rollups_
+             .try_emplace(Key{std::string(route_name), std::string(cluster_name), status_class})
+             .first;
+  }
+  ResponseRollup& rollup = it->second;
+  rollup.requests_++;
+  rollup.request_bytes_ += request_bytes;
+  rollup.response_bytes_ += response_bytes;
+  rollup.latency_.record(latency_ns);
+}
+
+void ResRollups::merge(ResRollups&& other) {
+  if (rollups_.empty()) {
+    rollups_.swap(other.rollups_);
+    return;
+  }
+  for (auto& entry : other.rollups_) {
+    auto result = rollups_.try_emplace(entry.first, std::move(entry.second));
+    if (!result.second) {
+      ResponseRollup& rollup = result.first->second;
+      rollup.requests_ += entry.second.requests_;
+      rollup.request_bytes_ += entry.second.request_bytes_;
+      rollup.response_bytes_ += entry.second.response_bytes_;
+      rollup.latency_.merge(entry.second.latency_);
+    }
+  }
+  other.rollups_.clear();
+}
+
+void ResRollups::toProto(envoy::service::mgw_res::v3::CheckRollup& proto) const {
+  proto.mutable_rollups()->Reserve(rollups_.size());
+  for (const auto& entry : rollups_) {
+    auto* rollup = proto.add_rollups();
+    rollup->set_route_name(entry.first.route_name_);
+    rollup->set_cluster_name(entry.first.cluster_name_);
+    rollup->set_status_class(entry.first.status_class_);
+    rollup->set_requests(entry.second.requests_);
+    rollup->set_request_bytes(entry.second.request_bytes_);
+    rollup->set_response_bytes(entry.second.response_bytes_);
+    entry.second.latency_.toProto(*rollup->mutable_latency());
+  }
+}
+
+GrpcResRollupReporterImpl::GrpcResRollupReporterImpl(
+    Grpc::RawAsyncClientPtr&& async_client,
+    const absl::optional<std::chrono::milliseconds>& timeout, Stats::Scope& scope,
+    const std::string& stats_prefix)
+    : service_method_(getRollupMethodDescriptor()), async_client_(std::move(async_client)),
+      timeout_(timeout),
+      stats_({ALL_MGW_RES_ROLLUP_STATS(POOL_COUNTER_PREFIX(scope, stats_prefix),
+                                       POOL_HISTOGRAM_PREFIX(scope, stats_prefix))}) {}
+
+void GrpcResRollupReporterImpl::report(const ResRollups& rollups,
+                                       std::chrono::nanoseconds interval) {
+  stats_.keys_.recordValue(rollups.size());
+  if (rollups.empty()) {
+    return;
+  }
+
+  envoy::service::mgw_res::v3::CheckRollup request;
+  request.set_interval_ns(interval.count());
+  rollups.toProto(request);
+  async_client_->send(service_method_, request, *this, Tracing::NullSpan::instance(),
+                      Http::AsyncClient::RequestOptions().setTimeout(timeout_));
+  stats_.reports_sent_.inc();
+}
+
+void GrpcResRollupReporterImpl::onFailure(Grpc::Status::GrpcStatus status,
+                                          const std::string& message, Tracing::Span&) {
+  ENVOY_LOG(debug, "mgw rollup report failed: status={} message={}", status, message);
+  stats_.report_failure_.inc();
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include "envoy/grpc/async_client.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "common/common/logger.h"
+#include "common/common/thread.h"
+#include "common/grpc/typed_async_client.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/strings/string_view.h"
+#include "mgw-source/filters/common/mgw/mgw_latency_sketch.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the rollup reporter. @see stats_macros.h
+ */
+#define ALL_MGW_RES_ROLLUP_STATS(COUNTER, HISTOGRAM)                                               \
+  COUNTER(reports_sent)                                                                            \
+  COUNTER(report_failure)                                                                          \
+  HISTOGRAM(keys, Unspecified)
+
+/**
+ * Wrapper struct for rollup reporter stats. @see stats_macros.h
+ */
+struct ResRollupStats {
+  ALL_MGW_RES_ROLLUP_STATS(GENERATE_COUNTER_STRUCT, GENERATE_HISTOGRAM_STRUCT)
+};
+
+/**
+ * Response totals of one route, cluster and status class.
+ */
+struct ResponseRollup {
+  uint64_t requests_{};
+  uint64_t request_bytes_{};
+  uint64_t response_bytes_{};
+  LatencySketch latency_;
+};
+
+/**
+ * Rollups keyed by route, cluster and status class. Each worker fills its own instance; the
+ * instances are merged when a report is due.
+ */
+class ResRollups {
+public:
+  /**
+   * Accounts one completed response.
+   */
+  void record(absl::string_view route_name, absl::string_view cluster_name, uint32_t status_class,
+              uint64_t request_bytes, uint64_t response_bytes, uint64_t latency_ns);
+
+  /**
+   * Moves all the rollups of another instance into this one.
+   */
+  void merge(ResRollups&& other);
+
+  bool empty() const { return rollups_.empty(); }
+  size_t size() const { return rollups_.size(); }
+
+  void toProto(envoy::service::mgw_res::v3::CheckRollup& proto) const;
+
+private:
+  struct Key {
+    std::string route_name_;
+    std::string cluster_name_;
+    uint32_t status_class_;
+  };
+  // Lets record() look up an existing key without copying the names.
+  struct KeyView {
+    absl::string_view route_name_;
+    absl::string_view cluster_name_;
+    uint32_t status_class_;
+  };
+  struct KeyHash {
+    using is_transparent = void;
+    template <class K> size_t operator()(const K& key) const {
+      return absl::Hash<std::tuple<absl::string_view, absl::string_view, uint32_t>>()(
+          std::make_tuple(absl::string_view(key.route_name_), absl::string_view(key.cluster_name_),
+                          key.status_class_));
+    }
+  };
+  struct KeyEq {
+    using is_transparent = void;
+    template <class A, class B> bool operator()(const A& a, const B& b) const {
+      return a.status_class_ == b.status_class_ &&
+             absl::string_view(a.route_name_) == absl::string_view(b.route_name_) &&
+             absl::string_view(a.cluster_name_) == absl::string_view(b.cluster_name_);
+    }
+  };
+
+  absl::flat_hash_map<Key, ResponseRollup, KeyHash, KeyEq> rollups_;
+};
+
+/**
+ * Collects the rollups of all workers for one report. Workers merge into it concurrently.
+ */
+class ResRollupCollector {
+public:
+  void merge(ResRollups&& rollups) {
+    Thread::LockGuard lock(lock_);
+    rollups_.merge(std::move(rollups));
+  }
+
+  ResRollups release() {
+    ResRollups rollups;
+    Thread::LockGuard lock(lock_);
+    rollups.merge(std::move(rollups_));
+    return rollups;
+  }
+
+private:
+  Thread::MutexBasicLockable lock_;
+  ResRollups rollups_ ABSL_GUARDED_BY(lock_);
+};
+
+/*
+ * Sends merged rollups to the mgw response service with InterceptRollup. Lives on the main
+ * thread. Replies are only counted.
+ */
+class GrpcResRollupReporterImpl
+    : public Grpc::AsyncRequestCallbacks<envoy::service::mgw_res::v3::CheckResponse>,
+      public Logger::Loggable<Logger::Id::filter> {
+public:
+  GrpcResRollupReporterImpl(Grpc::RawAsyncClientPtr&& async_client,
+                            const absl::optional<std::chrono::milliseconds>& timeout,
+                            Stats::Scope& scope, const std::string& stats_prefix);
+
+  /**
+   * Reports the rollups of one interval. Does nothing if there are none.
+   */
+  void report(const ResRollups& rollups, std::chrono::nanoseconds interval);
+
+  // Grpc::AsyncRequestCallbacks
+  void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+  void onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&&,
+                 Tracing::Span&) override {}
+  void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                 Tracing::Span& span) override;
+
+private:
+  const Protobuf::MethodDescriptor& service_method_;
+  Grpc::AsyncClient<envoy::service::mgw_res::v3::CheckRollup,
+                    envoy::service::mgw_res::v3::CheckResponse>
+      async_client_;
+  const absl::optional<std::chrono::milliseconds> timeout_;
+  ResRollupStats stats_;
+};
+
+using GrpcResRollupReporterImplSharedPtr = std::shared_ptr<GrpcResRollupReporterImpl>;
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
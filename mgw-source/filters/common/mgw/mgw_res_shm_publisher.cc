@@ -0,0 +1,203 @@
+#include "mgw-source/filters/common/mgw/mgw_res_shm_publisher.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include "common/common/assert.h"
+#include "common/common/fmt.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+constexpr uint32_t RingMagic = 0x4d475752; // "MGWR"
+constexpr uint32_t RingVersion = 1;
+// Most ring files tried before publishing is given up.
+constexpr uint32_t MaxRings = 1024;
+constexpr uint32_t RecordHeaderBytes = sizeof(uint32_t);
+
+} // namespace
+
+ShmResPublisherImpl::ShmResPublisherImpl(const ResShmConfig& config, const std::string& directory,
+                                         const ResShmStatsSharedPtr& stats,
+                                         const FallbackFactory& create_fallback)
+    : config_(config), stats_(stats) {
+  ASSERT((config_.ring_records_ & (config_.ring_records_ - 1)) == 0);
+  ASSERT(config_.record_bytes_ > RecordHeaderBytes);
+  openRing(directory);
+  if (header_ == nullptr && create_fallback) {
+    ENVOY_LOG(warn, "mgw shm: publishing without a ring through the fallback publisher");
+    fallback_ = create_fallback();
+  }
+}
+
+ShmResPublisherImpl::~ShmResPublisherImpl() {
+  // The ring stays for the agent to drain and for the next process to resume.
+  if (header_ != nullptr) {
+    ::munmap(header_, mapped_bytes_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+ResShmStats ShmResPublisherImpl::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_MGW_RES_SHM_STATS(POOL_COUNTER_PREFIX(scope, prefix))};
+}
+
+void ShmResPublisherImpl::openRing(const std::string& directory) {
+  const uint64_t ring_bytes = static_cast<uint64_t>(config_.ring_records_) * config_.record_bytes_;
+  if (ring_bytes > ResShmMaxRingBytes) {
+    // The filter config rejects such a shape, this only guards other users.
+    ENVOY_LOG(warn, "mgw shm: a ring of {} bytes is larger than the {} allowed", ring_bytes,
+              ResShmMaxRingBytes);
+    return;
+  }
+  mapped_bytes_ = ResShmRingDataOffset + ring_bytes;
+  // The lock is held for the life of the publisher, so another worker, a listener still draining
+  // with an older config or another process never writes into the same ring.
+  for (uint32_t index = 0; index < MaxRings; index++) {
+    const std::string path = fmt::format("{}/ring_{}", directory, index);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      ENVOY_LOG(warn, "mgw shm: cannot open {}: {}", path, strerror(errno));
+      return;
+    }
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+      ::close(fd);
+      continue;
+    }
+
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0) {
+      ENVOY_LOG(warn, "mgw shm: cannot use {}: {}", path, strerror(errno));
+      ::close(fd);
+      return;
+    }
+    // A ring of another shape is started over. One of the same shape keeps what the agent has
+    // not read yet.
+    const bool resize = file_stat.st_size != static_cast<off_t>(mapped_bytes_);
+    if (resize && ::ftruncate(fd, 0) != 0) {
+      ENVOY_LOG(warn, "mgw shm: cannot size {}: {}", path, strerror(errno));
+      ::close(fd);
+      return;
+    }
+    // Sizes the file and reserves its pages. A sparse ring on a full tmpfs would only fail at a
+    // store through the mapping, with SIGBUS.
+    const int error = ::posix_fallocate(fd, 0, mapped_bytes_);
+    if (error != 0) {
+      ENVOY_LOG(warn, "mgw shm: cannot allocate {}: {}", path, strerror(error));
+      ::close(fd);
+      return;
+    }
+    void* data = ::mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      ENVOY_LOG(warn, "mgw shm: cannot map {}: {}", path, strerror(errno));
+      ::close(fd);
+      return;
+    }
+
+    fd_ = fd;
+    header_ = static_cast<ResShmRingHeader*>(data);
+    records_ = static_cast<uint8_t*>(data) + ResShmRingDataOffset;
+    const uint64_t head = header_->head_.load(std::memory_order_relaxed);
+    const uint64_t tail = header_->tail_.load(std::memory_order_relaxed);
+    if (header_->magic_ == RingMagic && header_->version_ == RingVersion &&
+        header_->record_bytes_ == config_.record_bytes_ &&
+        header_->capacity_ == config_.ring_records_ && tail <= head &&
+        head - tail <= config_.ring_records_) {
+      head_ = head;
+      cached_tail_ = tail;
+      ENVOY_LOG(info, "mgw shm: resuming {} with {} unread records", path, head - tail);
+      return;
+    }
+    // A new or truncated file reads as zeros, so only the shape needs writing. The magic goes
+    // last so an agent never sees a half written header as valid.
+    header_->magic_ = 0;
+    header_->head_.store(0, std::memory_order_relaxed);
+    header_->tail_.store(0, std::memory_order_relaxed);
+    header_->published_.store(0, std::memory_order_relaxed);
+    header_->dropped_.store(0, std::memory_order_relaxed);
+    header_->version_ = RingVersion;
+    header_->record_bytes_ = config_.record_bytes_;
+    header_->capacity_ = config_.ring_records_;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic_ = RingMagic;
+    return;
+  }
+  ENVOY_LOG(warn, "mgw shm: no free ring in {}", directory);
+}
+
+void ShmResPublisherImpl::publish(const envoy::service::mgw_res::v3::CheckRequest& request) {
+  if (header_ == nullptr) {
+    if (fallback_ != nullptr) {
+      stats_->fallback_.inc();
+      fallback_->publish(request);
+      return;
+    }
+    stats_->no_ring_.inc();
+    return;
+  }
+  const size_t length = request.ByteSizeLong();
+  if (length > config_.record_bytes_ - RecordHeaderBytes) {
+    stats_->oversize_.inc();
+    return;
+  }
+  if (head_ - cached_tail_ >= config_.ring_records_) {
+    cached_tail_ = header_->tail_.load(std::memory_order_acquire);
+    if (head_ - cached_tail_ >= config_.ring_records_) {
+      header_->dropped_.fetch_add(1, std::memory_order_relaxed);
+      stats_->overflow_.inc();
+      return;
+    }
+  }
+
+  uint8_t* record =
+      records_ + (head_ & (config_.ring_records_ - 1)) * static_cast<size_t>(config_.record_bytes_);
+  request.SerializeWithCachedSizesToArray(record + RecordHeaderBytes);
+  const uint32_t record_length = static_cast<uint32_t>(length);
+  memcpy(record, &record_length, sizeof(record_length));
+  head_++;
+  // Release so the agent sees the record before the head that covers it.
+  header_->head_.store(head_, std::memory_order_release);
+  header_->published_.store(static_cast<uint32_t>(head_), std::memory_order_seq_cst);
+  stats_->published_.inc();
+  // Paired with the agent storing consumer_waiting_ before it rereads head_, so either it sees
+  // the new record or we see it waiting.
+  if (header_->consumer_waiting_.load(std::memory_order_seq_cst) != 0) {
+    wakeConsumer();
+  }
+}
+
+void ShmResPublisherImpl::wakeConsumer() {
+  if (header_->consumer_waiting_.exchange(0, std::memory_order_seq_cst) == 0) {
+    return;
+  }
+#ifdef __linux__
+  // Not FUTEX_PRIVATE_FLAG, the waiter is another process.
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header_->published_), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+#endif
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "common/common/logger.h"
+
+#include "mgw-source/filters/common/mgw/mgw.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the shared memory publisher. @see stats_macros.h
+ */
+#define ALL_MGW_RES_SHM_STATS(COUNTER)                                                             \
+  COUNTER(published)                                                                               \
+  COUNTER(overflow)                                                                                \
+  COUNTER(oversize)                                                                                \
+  COUNTER(no_ring)                                                                                 \
+  COUNTER(fallback)
+
+/**
+ * Wrapper struct for shared memory publisher stats. @see stats_macros.h
+ */
+struct ResShmStats {
+  ALL_MGW_RES_SHM_STATS(GENERATE_COUNTER_STRUCT)
+};
+
+using ResShmStatsSharedPtr = std::shared_ptr<ResShmStats>;
+
+/**
+ * Shape of the ring of one worker.
+ */
+struct ResShmConfig {
+  // A power of two.
+  uint32_t ring_records_;
+  // Including the length in front of each request.
+  uint32_t record_bytes_;
+};
+
+/**
+ * Start of every ring file, in native byte order. The proxy writes head_ and published_, the
+ * agent writes tail_. Record i lives at ResShmRingDataOffset + (i % capacity_) * record_bytes_
+ * and holds a 32 bit length followed by a serialized CheckRequest. Records [tail_, head_) are
+ * readable.
+ *
+ * An agent that wants to sleep stores 1 in consumer_waiting_, checks head_ once more and then
+ * FUTEX_WAITs on published_, the low 32 bits of head_. The proxy wakes it after the next record.
+ */
+struct ResShmRingHeader {
+  uint32_t magic_;
+  uint32_t version_;
+  uint32_t record_bytes_;
+  uint32_t capacity_;
+  alignas(64) std::atomic<uint64_t> head_;
+  alignas(64) std::atomic<uint64_t> tail_;
+  alignas(64) std::atomic<uint32_t> published_;
+  std::atomic<uint32_t> consumer_waiting_;
+  // Records the proxy dropped because the ring was full.
+  std::atomic<uint64_t> dropped_;
+};
+
+// The records start on the page after the header.
+constexpr size_t ResShmRingDataOffset = 4096;
+
+// Most record bytes of one ring. Each worker maps a ring, so this bounds the mapping per worker.
+constexpr uint64_t ResShmMaxRingBytes = uint64_t(1) << 30;
+
+static_assert(sizeof(ResShmRingHeader) <= ResShmRingDataOffset, "");
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "ring counters are shared between processes");
+
+/*
+ * Async mode publisher for an analytics agent on the same host. Each worker writes into a single
+ * producer, single consumer ring in a memory-mapped ring_<n> file of the configured directory,
+ * the first one not locked by another publisher, so a restarted proxy resumes the rings of the
+ * previous one. Publishing never blocks or makes a system call unless the agent is asleep: when
+ * the ring is full the request is dropped and counted. If no ring can be opened, requests go to
+ * a fallback publisher instead. It must only be used from the worker that created it.
+ */
+class ShmResPublisherImpl : public ResPublisher, public Logger::Loggable<Logger::Id::filter> {
+public:
+  using FallbackFactory = std::function<ResPublisherPtr()>;
+
+  /**
+   * @param directory holds the ring files. It must exist.
+   * @param create_fallback makes the publisher used when no ring can be opened. Requests are
+   *        dropped instead if it is empty.
+   */
+  ShmResPublisherImpl(const ResShmConfig& config, const std::string& directory,
+                      const ResShmStatsSharedPtr& stats, const FallbackFactory& create_fallback);
+  ~ShmResPublisherImpl() override;
+
+  static ResShmStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  // MGW::ResPublisher
+  void publish(const envoy::service::mgw_res::v3::CheckRequest& request) override;
+
+private:
+  void openRing(const std::string& directory);
+  void wakeConsumer();
+
+  const ResShmConfig config_;
+  ResShmStatsSharedPtr stats_;
+  int fd_{-1};
+  size_t mapped_bytes_{};
+  // Null if no ring could be opened, then every request is dropped.
+  ResShmRingHeader* header_{};
+  uint8_t* records_{};
+  // Only this publisher writes head_, so it is tracked locally. tail_ is reread only when the
+  // ring looks full.
+  uint64_t head_{};
+  uint64_t cached_tail_{};
+  // Set only if there is no ring.
+  ResPublisherPtr fallback_;
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,189 @@
+#include "mgw-source/filters/common/mgw/mgw_res_single_flight.h"
+
+#include <algorithm>
+
+#include "common/common/assert.h"
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+// Appends a length prefixed field, so that the fields of two different keys never line up into
+// the same bytes.
+void appendKeyField(std::string& key, absl::string_view field) {
+  const uint32_t length = field.size();
+  key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+  key.append(field.data(), field.size());
+}
+
+} // namespace
+
+void ResSingleFlight::buildKey(const envoy::service::mgw_res::v3::CheckRequest& request,
+                               const StreamInfo::StreamInfo& stream_info) {
+  key_.clear();
+  const uint32_t response_code = request.response_code();
+  key_.append(reinterpret_cast<const char*>(&response_code), sizeof(response_code));
+  appendKeyField(key_, request.route_name());
+  appendKeyField(key_, request.cluster_name());
+  const Http::RequestHeaderMap* request_headers = stream_info.getRequestHeaders();
+  appendKeyField(key_, request_headers != nullptr ? request_headers->getMethodValue() : "");
+  // Headers that are not present are left out of the request, their names mark the ones that are.
+  for (const auto& header : request.response_headers()) {
+    appendKeyField(key_, header.name());
+    appendKeyField(key_, header.value());
+  }
+}
+
+ResSingleFlight::ResSingleFlight(uint32_t max_waiters, const ResSingleFlightStatsSharedPtr& stats,
+                                 ResPublisher* publisher, Event::Dispatcher& dispatcher)
+    : max_waiters_(max_waiters), stats_(stats), publisher_(publisher), dispatcher_(dispatcher) {}
+
+ResSingleFlight::~ResSingleFlight() {
+  // Every stream answers or cancels its call before the worker's state goes away.
+  ASSERT(flights_.empty());
+}
+
+ResSingleFlightStats ResSingleFlight::generateStats(const std::string& prefix,
+                                                    Stats::Scope& scope) {
+  return {ALL_MGW_SINGLE_FLIGHT_STATS(POOL_COUNTER_PREFIX(scope, prefix))};
+}
+
+void ResSingleFlight::Flight::start() {
+  SingleFlightResClient& leader = *waiters_.front();
+  deadline_ = leader.deadline_;
+  // A restarted call gets what is left. Never 0, which would disable the timeout.
+  const std::chrono::milliseconds timeout = std::max(
+      std::chrono::milliseconds(1),
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline_ - parent_.dispatcher_.timeSource().monotonicTime()));
+  client_ = leader.create_client_(timeout);
+  // May complete inline, which hands the flight over for deferred deletion.
+  client_->intercept(*this, *leader.request_, *leader.parent_span_, *leader.stream_info_);
+}
+
+void ResSingleFlight::Flight::onResponseComplete(ResponsePtr&& response) {
+  completing_ = true;
+  // Out of the table first, so that identical calls made from the callbacks start a flight of
+  // their own. The client that answered is still on the stack, hence the deferred delete.
+  auto it = parent_.flights_.find(key_);
+  ASSERT(it != parent_.flights_.end() && it->second.get() == this);
+  parent_.dispatcher_.deferredDelete(std::move(it->second));
+  parent_.flights_.erase(it);
+
+  for (size_t i = 0; i < waiters_.size(); i++) {
+    SingleFlightResClient* waiter = waiters_[i];
+    if (waiter == nullptr) {
+      continue;
+    }
+    if (i > 0 && parent_.publisher_ != nullptr) {
+      // Only the first waiter's request went out with the call.
+      parent_.publisher_->publish(*waiter->request_);
+    }
+    ResponseCallbacks* callbacks = waiter->callbacks_;
+    waiter->callbacks_ = nullptr;
+    waiter->flight_ = nullptr;
+    if (i + 1 == waiters_.size()) {
+      callbacks->onResponseComplete(std::move(response));
+      break;
+    }
+    ResponsePtr copy = createResponse();
+    *copy = *response;
+    callbacks->onResponseComplete(std::move(copy));
+  }
+}
+
+void ResSingleFlight::cancel(Flight& flight, SingleFlightResClient& waiter) {
+  auto waiter_it = std::find(flight.waiters_.begin(), flight.waiters_.end(), &waiter);
+  ASSERT(waiter_it != flight.waiters_.end());
+  if (flight.completing_) {
+    // Cancelled from the callbacks of another waiter. Its answer must not be delivered.
+    *waiter_it = nullptr;
+    return;
+  }
+  const bool leader = waiter_it == flight.waiters_.begin();
+  flight.waiters_.erase(waiter_it);
+  if (!leader) {
+    return;
+  }
+
+  // The call refers to the leader's request, span and stream info, which are about to go away.
+  flight.client_->cancel();
+  if (flight.waiters_.empty()) {
+    flights_.erase(flights_.find(flight.key_));
+    return;
+  }
+  stats_->restarted_.inc();
+  // Made for the waiter that has to be answered first, which keeps every other deadline after the
+  // call's.
+  auto earliest = std::min_element(
+      flight.waiters_.begin(), flight.waiters_.end(),
+      [](const SingleFlightResClient* a, const SingleFlightResClient* b) -> bool {
+        return a->deadline_ < b->deadline_;
+      });
+  std::rotate(flight.waiters_.begin(), earliest, earliest + 1);
+  flight.start();
+}
+
+SingleFlightResClient::~SingleFlightResClient() { ASSERT(flight_ == nullptr); }
+
+void SingleFlightResClient::cancel() {
+  ASSERT(callbacks_ != nullptr);
+  callbacks_ = nullptr;
+  if (direct_client_ != nullptr) {
+    direct_client_->cancel();
+    return;
+  }
+  ResSingleFlight::Flight* flight = flight_;
+  flight_ = nullptr;
+  table_.cancel(*flight, *this);
+}
+
+void SingleFlightResClient::intercept(ResponseCallbacks& callbacks,
+                                      const envoy::service::mgw_res::v3::CheckRequest& request,
+                                      Tracing::Span& parent_span,
+                                      const StreamInfo::StreamInfo& stream_info) {
+  ASSERT(callbacks_ == nullptr);
+  callbacks_ = &callbacks;
+  request_ = &request;
+  parent_span_ = &parent_span;
+  stream_info_ = &stream_info;
+  deadline_ = table_.dispatcher_.timeSource().monotonicTime() + timeout_;
+
+  // Keys are compared byte for byte, so a hash collision can never hand out the wrong answer.
+  table_.buildKey(request, stream_info);
+  auto it = table_.flights_.find(table_.key_);
+  if (it != table_.flights_.end()) {
+    if (it->second->deadline_ > deadline_) {
+      // The call may still be in flight after this one should have failed.
+      table_.stats_->deadline_bypassed_.inc();
+    } else if (it->second->waiters_.size() < table_.max_waiters_) {
+      table_.stats_->coalesced_.inc();
+      flight_ = it->second.get();
+      flight_->waiters_.push_back(this);
+      return;
+    }
+    table_.stats_->calls_.inc();
+    direct_client_ = create_client_(timeout_);
+    direct_client_->intercept(callbacks, request, parent_span, stream_info);
+    return;
+  }
+
+  table_.stats_->calls_.inc();
+  auto flight = std::make_unique<ResSingleFlight::Flight>(table_, table_.key_);
+  flight_ = flight.get();
+  flight_->waiters_.push_back(this);
+  table_.flights_.emplace(table_.key_, std::move(flight));
+  flight_->start();
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
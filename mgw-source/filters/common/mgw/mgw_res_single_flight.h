@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/common/time.h"
+#include "envoy/event/deferred_deletable.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "mgw-source/filters/common/mgw/mgw.h"
+
+#include "absl/container/flat_hash_map.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the intercept single flight table. @see stats_macros.h
+ */
+#define ALL_MGW_SINGLE_FLIGHT_STATS(COUNTER)                                                       \
+  COUNTER(calls)                                                                                   \
+  COUNTER(coalesced)                                                                               \
+  COUNTER(deadline_bypassed)                                                                       \
+  COUNTER(restarted)
+
+/**
+ * Wrapper struct for intercept single flight stats. @see stats_macros.h
+ */
+struct ResSingleFlightStats {
+  ALL_MGW_SINGLE_FLIGHT_STATS(GENERATE_COUNTER_STRUCT)
+};
+
+using ResSingleFlightStatsSharedPtr = std::shared_ptr<ResSingleFlightStats>;
+
+class SingleFlightResClient;
+
+/**
+ * Per worker table of the sync intercept calls in flight. Calls are keyed by the response code,
+ * route, cluster, request method and projected response headers of their request. Timings, byte
+ * counts, the captured body and the request id are left out: they differ between any two streams,
+ * so a key with them would never match. Only the decision is shared: once the call is answered
+ * the request of every other waiter is handed to the publisher, so that the service still sees
+ * one event per stream. Not thread safe.
+ */
+class ResSingleFlight {
+public:
+  /**
+   * @param publisher where the requests of the waiters that did not make the call go. May be
+   *        null, as on the main thread, which never runs a filter.
+   */
+  ResSingleFlight(uint32_t max_waiters, const ResSingleFlightStatsSharedPtr& stats,
+                  ResPublisher* publisher, Event::Dispatcher& dispatcher);
+  ~ResSingleFlight();
+
+  static ResSingleFlightStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+private:
+  friend class SingleFlightResClient;
+
+  /**
+   * One call and the clients waiting for its answer. The first waiter made the call; its
+   * request, span, stream info and deadline are the ones in use. Every other waiter's deadline is
+   * at or after the call's, so none of them waits longer than it would on its own.
+   */
+  struct Flight : public ResponseCallbacks, public Event::DeferredDeletable {
+    Flight(ResSingleFlight& parent, const std::string& key) : parent_(parent), key_(key) {}
+
+    // Makes the call on behalf of the first waiter, with the time left until its deadline.
+    void start();
+
+    // MGW::ResponseCallbacks
+    void onResponseComplete(ResponsePtr&& response) override;
+
+    ResSingleFlight& parent_;
+    const std::string key_;
+    ResClientPtr client_;
+    // By when the call is answered or has failed.
+    MonotonicTime deadline_;
+    // Cancelled waiters are removed, or set to null while the answer is being handed out.
+    std::vector<SingleFlightResClient*> waiters_;
+    bool completing_{};
+  };
+  using FlightPtr = std::unique_ptr<Flight>;
+
+  void cancel(Flight& flight, SingleFlightResClient& waiter);
+  // Sets key_ to the key of a call.
+  void buildKey(const envoy::service::mgw_res::v3::CheckRequest& request,
+                const StreamInfo::StreamInfo& stream_info);
+
+  const uint32_t max_waiters_;
+  ResSingleFlightStatsSharedPtr stats_;
+  ResPublisher* publisher_;
+  Event::Dispatcher& dispatcher_;
+  absl::flat_hash_map<std::string, FlightPtr> flights_;
+  // Reused for the key of each call.
+  std::string key_;
+};
+
+using ResSingleFlightPtr = std::unique_ptr<ResSingleFlight>;
+
+/*
+ * Sync mode client that shares calls through a ResSingleFlight. If a call with the same key is
+ * in flight and will end by this client's deadline, it waits for that call's answer, which is
+ * copied to every waiter. Otherwise it makes the call with a client from create_client, as do the
+ * clients that join it. When the client that made the call is cancelled while others still wait,
+ * the call is made again for the waiter with the earliest deadline. Created for each filter stack
+ * like GrpcResClientImpl.
+ */
+class SingleFlightResClient : public ResClient {
+public:
+  // Makes a client for one call with the given timeout.
+  using ClientFactory = std::function<ResClientPtr(std::chrono::milliseconds timeout)>;
+
+  SingleFlightResClient(ResSingleFlight& table, std::chrono::milliseconds timeout,
+                        ClientFactory create_client)
+      : table_(table), timeout_(timeout), create_client_(std::move(create_client)) {}
+  ~SingleFlightResClient() override;
+
+  // MGW::ResClient
+  void cancel() override;
+  void intercept(ResponseCallbacks& callbacks,
+                 const envoy::service::mgw_res::v3::CheckRequest& request,
+                 Tracing::Span& parent_span, const StreamInfo::StreamInfo& stream_info) override;
+
+private:
+  friend class ResSingleFlight;
+
+  ResSingleFlight& table_;
+  const std::chrono::milliseconds timeout_;
+  const ClientFactory create_client_;
+  // Set when the call is made, from timeout_.
+  MonotonicTime deadline_;
+  ResponseCallbacks* callbacks_{};
+  // Valid while waiting; the filter keeps them alive until it is answered or cancelled.
+  const envoy::service::mgw_res::v3::CheckRequest* request_{};
+  Tracing::Span* parent_span_{};
+  const StreamInfo::StreamInfo* stream_info_{};
+  // The flight waited for, null if the call was made without the table or is complete.
+  ResSingleFlight::Flight* flight_{};
+  // Used instead of the table when the flight to join already has the most waiters.
+  ResClientPtr direct_client_;
+};
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,347 @@
+#include "mgw-source/filters/common/mgw/mgw_res_spool.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "common/common/assert.h"
+#include "common/common/fmt.h"
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+constexpr uint32_t SegmentMagic = 0x4d475753; // "MGWS"
+constexpr absl::string_view SegmentPrefix = "segment_";
+constexpr absl::string_view SegmentSuffix = ".log";
+constexpr std::chrono::milliseconds ReplayInterval{100};
+// Most worker subdirectories tried before spooling is given up.
+constexpr uint32_t MaxWorkerDirectories = 1024;
+
+/**
+ * Start of every segment file. read_offset_ is advanced in place as records are replayed, so a
+ * restarted process resumes where the last one stopped.
+ */
+struct SegmentHeader {
+  uint32_t magic_;
+  uint32_t reserved_;
+  uint64_t read_offset_;
+};
+
+// Records are a native endian 32 bit length followed by the serialized request. A zero length
+// marks the end of the written records, which holds because new segments are zero filled.
+constexpr uint32_t RecordHeaderBytes = sizeof(uint32_t);
+
+uint32_t recordLength(const uint8_t* at) {
+  uint32_t length;
+  memcpy(&length, at, sizeof(length));
+  return length;
+}
+
+} // namespace
+
+ResSpool::ResSpool(const ResSpoolConfig& config, const std::string& directory,
+                   const ResSpoolStatsSharedPtr& stats, Event::Dispatcher& dispatcher)
+    : config_(config), stats_(stats),
+      replay_timer_(dispatcher.createTimer([this]() -> void { replay(); })) {
+  lockDirectory(directory);
+  if (!directory_.empty()) {
+    loadSegments();
+  }
+}
+
+ResSpool::~ResSpool() {
+  // The segments stay on disk for the next process.
+  for (auto& segment : segments_) {
+    closeSegment(*segment, false);
+  }
+  if (lock_fd_ >= 0) {
+    ::close(lock_fd_);
+  }
+}
+
+ResSpoolStats ResSpool::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_MGW_RES_SPOOL_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                  POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+void ResSpool::lockDirectory(const std::string& parent) {
+  // Another worker, a listener still draining with an older config or another process may hold
+  // a subdirectory. Taking the first free one lets a restart resume the segments of a previous
+  // process.
+  for (uint32_t index = 0; index < MaxWorkerDirectories; index++) {
+    const std::string directory = fmt::format("{}/worker_{}", parent, index);
+    if (::mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+      ENVOY_LOG(warn, "mgw spool: cannot create {}: {}", directory, strerror(errno));
+      return;
+    }
+    const int fd = ::open((directory + "/lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      ENVOY_LOG(warn, "mgw spool: cannot open the lock of {}: {}", directory, strerror(errno));
+      return;
+    }
+    if (::flock(fd, LOCK_EX | LOCK_NB) == 0) {
+      directory_ = directory;
+      lock_fd_ = fd;
+      return;
+    }
+    ::close(fd);
+  }
+  ENVOY_LOG(warn, "mgw spool: no free worker directory in {}", parent);
+}
+
+ResSpool::SegmentPtr ResSpool::openSegment(uint64_t sequence, bool create) {
+  const std::string path =
+      fmt::format("{}/{}{:020}{}", directory_, SegmentPrefix, sequence, SegmentSuffix);
+  const int fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+  if (fd < 0) {
+    ENVOY_LOG(warn, "mgw spool: cannot open {}: {}", path, strerror(errno));
+    return nullptr;
+  }
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0 ||
+      (!create && file_stat.st_size != static_cast<off_t>(config_.segment_bytes_))) {
+    ENVOY_LOG(warn, "mgw spool: cannot use {}", path);
+    ::close(fd);
+    ::unlink(path.c_str());
+    return nullptr;
+  }
+  if (create) {
+    // The blocks are reserved now. A sparse segment on a full disk would only fail at a write
+    // through the mapping, with SIGBUS. The caller drops the request.
+    const int error = ::posix_fallocate(fd, 0, config_.segment_bytes_);
+    if (error != 0) {
+      ENVOY_LOG(warn, "mgw spool: cannot allocate {}: {}", path, strerror(error));
+      ::close(fd);
+      ::unlink(path.c_str());
+      return nullptr;
+    }
+  }
+  void* data = ::mmap(nullptr, config_.segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    ENVOY_LOG(warn, "mgw spool: cannot map {}: {}", path, strerror(errno));
+    ::unlink(path.c_str());
+    return nullptr;
+  }
+
+  auto segment = std::make_unique<Segment>();
+  segment->sequence_ = sequence;
+  segment->path_ = path;
+  segment->data_ = static_cast<uint8_t*>(data);
+  SegmentHeader header;
+  if (create) {
+    header = {SegmentMagic, 0, sizeof(SegmentHeader)};
+    memcpy(segment->data_, &header, sizeof(header));
+    segment->write_offset_ = sizeof(SegmentHeader);
+  } else {
+    memcpy(&header, segment->data_, sizeof(header));
+    if (header.magic_ != SegmentMagic || header.read_offset_ < sizeof(SegmentHeader) ||
+        header.read_offset_ > config_.segment_bytes_) {
+      ENVOY_LOG(warn, "mgw spool: {} is not a spool segment", path);
+      closeSegment(*segment, true);
+      return nullptr;
+    }
+    // Find the end of the records that were written.
+    uint64_t offset = header.read_offset_;
+    while (offset + RecordHeaderBytes <= config_.segment_bytes_) {
+      const uint32_t length = recordLength(segment->data_ + offset);
+      if (length == 0 || offset + RecordHeaderBytes + length > config_.segment_bytes_) {
+        break;
+      }
+      offset += RecordHeaderBytes + length;
+    }
+    segment->write_offset_ = offset;
+  }
+  stats_->bytes_.add(config_.segment_bytes_);
+  return segment;
+}
+
+void ResSpool::closeSegment(Segment& segment, bool remove) {
+  ::munmap(segment.data_, config_.segment_bytes_);
+  if (remove) {
+    ::unlink(segment.path_.c_str());
+  }
+  stats_->bytes_.sub(config_.segment_bytes_);
+}
+
+void ResSpool::loadSegments() {
+  DIR* dir = ::opendir(directory_.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+  std::vector<uint64_t> sequences;
+  while (const dirent* entry = ::readdir(dir)) {
+    absl::string_view name(entry->d_name);
+    uint64_t sequence;
+    if (absl::StartsWith(name, SegmentPrefix) && absl::EndsWith(name, SegmentSuffix) &&
+        absl::SimpleAtoi(name.substr(SegmentPrefix.size(), name.size() - SegmentPrefix.size() -
+                                                               SegmentSuffix.size()),
+                         &sequence)) {
+      sequences.push_back(sequence);
+    }
+  }
+  ::closedir(dir);
+
+  std::sort(sequences.begin(), sequences.end());
+  for (const uint64_t sequence : sequences) {
+    next_sequence_ = sequence + 1;
+    SegmentPtr segment = openSegment(sequence, false);
+    if (segment != nullptr) {
+      segments_.push_back(std::move(segment));
+    }
+  }
+  // The configured size may have shrunk since the segments were written.
+  while (segments_.size() > 1 && segments_.size() * config_.segment_bytes_ > config_.max_bytes_) {
+    evictOldest();
+  }
+  if (!segments_.empty()) {
+    ENVOY_LOG(info, "mgw spool: resuming {} segments in {}", segments_.size(), directory_);
+  }
+}
+
+uint64_t& ResSpool::readOffset(Segment& segment) {
+  return reinterpret_cast<SegmentHeader*>(segment.data_)->read_offset_;
+}
+
+bool ResSpool::rollSegment() {
+  while (!segments_.empty() &&
+         (segments_.size() + 1) * config_.segment_bytes_ > config_.max_bytes_) {
+    evictOldest();
+  }
+  if (directory_.empty()) {
+    return false;
+  }
+  SegmentPtr segment = openSegment(next_sequence_++, true);
+  if (segment == nullptr) {
+    return false;
+  }
+  segments_.push_back(std::move(segment));
+  return true;
+}
+
+void ResSpool::evictOldest() {
+  Segment& oldest = *segments_.front();
+  uint64_t offset = readOffset(oldest);
+  while (offset < oldest.write_offset_) {
+    offset += RecordHeaderBytes + recordLength(oldest.data_ + offset);
+    stats_->events_evicted_.inc();
+  }
+  stats_->segments_evicted_.inc();
+  closeSegment(oldest, true);
+  segments_.pop_front();
+}
+
+void ResSpool::append(const envoy::service::mgw_res::v3::CheckRequest& request) {
+  const size_t length = request.ByteSizeLong();
+  const size_t record_bytes = RecordHeaderBytes + length;
+  if (length == 0 || record_bytes > config_.segment_bytes_ - sizeof(SegmentHeader)) {
+    stats_->events_dropped_.inc();
+    return;
+  }
+  if ((segments_.empty() ||
+       segments_.back()->write_offset_ + record_bytes > config_.segment_bytes_) &&
+      !rollSegment()) {
+    stats_->events_dropped_.inc();
+    return;
+  }
+
+  Segment& segment = *segments_.back();
+  uint8_t* at = segment.data_ + segment.write_offset_;
+  if (segment.write_offset_ + record_bytes + RecordHeaderBytes <= config_.segment_bytes_) {
+    // A write torn by a crash may have left bytes past this record. Ending the records after it
+    // keeps them from being read as one when the segment is resumed.
+    memset(at + record_bytes, 0, RecordHeaderBytes);
+  }
+  // The payload goes first so a crash between the two writes leaves a zero length, which ends
+  // the records instead of pointing at garbage.
+  request.SerializeWithCachedSizesToArray(at + RecordHeaderBytes);
+  const uint32_t record_length = static_cast<uint32_t>(length);
+  memcpy(at, &record_length, sizeof(record_length));
+  segment.write_offset_ += record_bytes;
+  stats_->events_spooled_.inc();
+  maybeEnableReplayTimer();
+}
+
+void ResSpool::setReplayEnabled(bool enabled) {
+  replay_enabled_ = enabled;
+  if (!enabled) {
+    replay_timer_->disableTimer();
+    return;
+  }
+  maybeEnableReplayTimer();
+}
+
+bool ResSpool::empty() const {
+  return segments_.empty() ||
+         (segments_.size() == 1 &&
+          reinterpret_cast<const SegmentHeader*>(segments_.front()->data_)->read_offset_ ==
+              segments_.front()->write_offset_);
+}
+
+void ResSpool::maybeEnableReplayTimer() {
+  if (replay_enabled_ && !replay_timer_->enabled() && !empty()) {
+    replay_timer_->enableTimer(ReplayInterval);
+  }
+}
+
+void ResSpool::replay() {
+  ASSERT(replay_cb_ != nullptr);
+  const uint32_t budget = std::max<uint32_t>(
+      1, config_.replay_rate_ * ReplayInterval.count() / 1000);
+  envoy::service::mgw_res::v3::CheckRequest request;
+  for (uint32_t replayed = 0; replayed < budget && replay_enabled_ && !segments_.empty();) {
+    Segment& oldest = *segments_.front();
+    uint64_t& read_offset = readOffset(oldest);
+    if (read_offset == oldest.write_offset_) {
+      if (segments_.size() == 1) {
+        break;
+      }
+      closeSegment(oldest, true);
+      segments_.pop_front();
+      continue;
+    }
+
+    const uint32_t length = recordLength(oldest.data_ + read_offset);
+    const bool parsed = request.ParseFromArray(oldest.data_ + read_offset + RecordHeaderBytes,
+                                               static_cast<int>(length));
+    // Advance before replaying, the callback may spool the request again.
+    read_offset += RecordHeaderBytes + length;
+    if (!parsed) {
+      stats_->events_dropped_.inc();
+      continue;
+    }
+    stats_->events_replayed_.inc();
+    replayed++;
+    replay_cb_(request);
+  }
+
+  if (segments_.size() == 1 && empty()) {
+    // Fully replayed, start the next append from the beginning of a fresh segment.
+    closeSegment(*segments_.front(), true);
+    segments_.pop_front();
+  }
+  maybeEnableReplayTimer();
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "common/common/logger.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the intercept spool. @see stats_macros.h
+ */
+#define ALL_MGW_RES_SPOOL_STATS(COUNTER, GAUGE)                                                    \
+  COUNTER(events_spooled)                                                                          \
+  COUNTER(events_replayed)                                                                         \
+  COUNTER(events_evicted)                                                                          \
+  COUNTER(events_dropped)                                                                          \
+  COUNTER(segments_evicted)                                                                        \
+  GAUGE(bytes, Accumulate)
+
+/**
+ * Wrapper struct for intercept spool stats. @see stats_macros.h
+ */
+struct ResSpoolStats {
+  ALL_MGW_RES_SPOOL_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+using ResSpoolStatsSharedPtr = std::shared_ptr<ResSpoolStats>;
+
+/**
+ * Limits of the intercept spool of one worker.
+ */
+struct ResSpoolConfig {
+  uint64_t max_bytes_;
+  uint32_t segment_bytes_;
+  // Events replayed per second.
+  uint32_t replay_rate_;
+};
+
+/*
+ * Per worker on-disk queue of intercept requests that could not be delivered. Requests are
+ * appended to fixed size, memory-mapped segment files in a worker_<n> subdirectory, the first one
+ * not locked by another spool. Once the
+ * publisher reports the service healthy again, the oldest requests are replayed through it at a
+ * bounded rate from a timer on the worker's dispatcher. When the spool is full the oldest segment
+ * is evicted. Segments left by a previous process are picked up and replayed. Delivery is at
+ * least once: a replayed request that fails again is spooled again. It must only be used from
+ * the dispatcher it was created with.
+ */
+class ResSpool : public Logger::Loggable<Logger::Id::filter> {
+public:
+  using ReplayCb = std::function<void(const envoy::service::mgw_res::v3::CheckRequest&)>;
+
+  /**
+   * @param directory parent of the worker subdirectories. It must exist.
+   */
+  ResSpool(const ResSpoolConfig& config, const std::string& directory,
+           const ResSpoolStatsSharedPtr& stats, Event::Dispatcher& dispatcher);
+  ~ResSpool();
+
+  static ResSpoolStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  /**
+   * Sets where replayed requests go, normally the publisher that owns the spool.
+   */
+  void setReplayCallback(ReplayCb replay_cb) { replay_cb_ = std::move(replay_cb); }
+
+  /**
+   * Writes a request to the end of the spool.
+   */
+  void append(const envoy::service::mgw_res::v3::CheckRequest& request);
+
+  /**
+   * Turns replay on while the service accepts requests and off while it fails.
+   */
+  void setReplayEnabled(bool enabled);
+
+private:
+  struct Segment {
+    uint64_t sequence_;
+    std::string path_;
+    uint8_t* data_;
+    // End of the written records.
+    uint32_t write_offset_;
+  };
+  using SegmentPtr = std::unique_ptr<Segment>;
+
+  // Creates and locks the first free worker subdirectory. Leaves directory_ empty if there is
+  // none.
+  void lockDirectory(const std::string& parent);
+  // Maps an existing segment file, or creates it if create is set.
+  SegmentPtr openSegment(uint64_t sequence, bool create);
+  void closeSegment(Segment& segment, bool remove);
+  void loadSegments();
+  // Starts a new write segment, evicting the oldest ones to stay under max_bytes.
+  bool rollSegment();
+  void evictOldest();
+  uint64_t& readOffset(Segment& segment);
+  bool empty() const;
+  void maybeEnableReplayTimer();
+  void replay();
+
+  const ResSpoolConfig config_;
+  std::string directory_;
+  // Held open for its lock, -1 if no directory could be locked.
+  int lock_fd_{-1};
+  ResSpoolStatsSharedPtr stats_;
+  ReplayCb replay_cb_;
+  // Oldest first. The last segment is the one being written.
+  std::deque<SegmentPtr> segments_;
+  uint64_t next_sequence_{};
+  bool replay_enabled_{};
+  Event::TimerPtr replay_timer_;
+};
+
+using ResSpoolPtr = std::unique_ptr<ResSpool>;
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
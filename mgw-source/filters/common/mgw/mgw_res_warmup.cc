@@ -0,0 +1,98 @@
+#include "mgw-source/filters/common/mgw/mgw_res_warmup.h"
+
+#include "common/common/assert.h"
+#include "common/tracing/http_tracer_impl.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+namespace {
+
+constexpr char InterceptBatchMethod[] = "envoy.service.mgw_res.v3.MGWResponse.InterceptBatch";
+
+const Protobuf::MethodDescriptor& getBatchMethodDescriptor() {
+  const auto* descriptor =
+      Protobuf::DescriptorPool::generated_pool()->FindMethodByName(InterceptBatchMethod);
+  ASSERT(descriptor != nullptr);
+  return *descriptor;
+}
+
+// Statuses the proxy reports for calls that never reached the service: no healthy host or a
+// failed connection, a reset stream and the probe's own timeout.
+bool reachedService(Grpc::Status::GrpcStatus status) {
+  return status != Grpc::Status::WellKnownGrpcStatus::Unavailable &&
+         status != Grpc::Status::WellKnownGrpcStatus::Internal &&
+         status != Grpc::Status::WellKnownGrpcStatus::DeadlineExceeded;
+}
+
+} // namespace
+
+ResWarmup::ResWarmup(const Grpc::RawAsyncClientSharedPtr& async_client,
+                     std::chrono::milliseconds retry_interval,
+                     const ResWarmupStatsSharedPtr& stats, Event::Dispatcher& dispatcher)
+    : service_method_(getBatchMethodDescriptor()), async_client_(async_client),
+      retry_interval_(retry_interval), stats_(stats),
+      retry_timer_(dispatcher.createTimer([this]() -> void { probe(); })) {
+  stats_->warming_.inc();
+  // Made from the worker's loop rather than here, once the thread local state of the cluster
+  // manager is in place on this worker as well.
+  retry_timer_->enableTimer(std::chrono::milliseconds(0));
+}
+
+ResWarmup::~ResWarmup() {
+  if (request_ != nullptr) {
+    request_->cancel();
+  }
+  if (warm_) {
+    stats_->warm_.dec();
+  } else {
+    stats_->warming_.dec();
+  }
+}
+
+ResWarmupStats ResWarmup::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_MGW_RES_WARMUP_STATS(POOL_COUNTER_PREFIX(scope, prefix),
+                                   POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+void ResWarmup::probe() {
+  ASSERT(request_ == nullptr && !warm_);
+  // An empty batch, which the service accepts without recording anything.
+  const envoy::service::mgw_res::v3::CheckRequestBatch batch;
+  // Null if the call failed inline, onFailure() has then already run.
+  request_ = async_client_->send(service_method_, batch, *this, Tracing::NullSpan::instance(),
+                                 Http::AsyncClient::RequestOptions().setTimeout(retry_interval_));
+}
+
+void ResWarmup::onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&&,
+                          Tracing::Span&) {
+  request_ = nullptr;
+  setWarm();
+}
+
+void ResWarmup::onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                          Tracing::Span&) {
+  request_ = nullptr;
+  if (reachedService(status)) {
+    setWarm();
+    return;
+  }
+  ENVOY_LOG(debug, "mgw warm up probe failed with status {}: {}", status, message);
+  stats_->probe_failed_.inc();
+  retry_timer_->enableTimer(retry_interval_);
+}
+
+void ResWarmup::setWarm() {
+  warm_ = true;
+  stats_->warming_.dec();
+  stats_->warm_.inc();
+}
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
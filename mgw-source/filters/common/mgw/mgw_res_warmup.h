@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/grpc/async_client.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
+
+#include "common/common/logger.h"
+#include "common/grpc/typed_async_client.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+
+/**
+ * All stats for the connection warm up. @see stats_macros.h
+ */
+#define ALL_MGW_RES_WARMUP_STATS(COUNTER, GAUGE)                                                   \
+  COUNTER(probe_failed)                                                                            \
+  GAUGE(warming, Accumulate)                                                                       \
+  GAUGE(warm, Accumulate)
+
+/**
+ * Wrapper struct for connection warm up stats. @see stats_macros.h
+ */
+struct ResWarmupStats {
+  ALL_MGW_RES_WARMUP_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+using ResWarmupStatsSharedPtr = std::shared_ptr<ResWarmupStats>;
+
+/**
+ * Opens the connection of a worker to the response service before the first response needs it.
+ * An empty InterceptBatch is sent as soon as the worker runs and again every retry interval until
+ * the service answers. Any answer from the service counts, including an error status; only the
+ * statuses the proxy itself reports when no connection could be used mean another try. While the
+ * probe is outstanding the worker is counted in the warming gauge, afterwards in the warm one, so
+ * a config is ready once warming drops to zero.
+ */
+class ResWarmup : public Grpc::AsyncRequestCallbacks<envoy::service::mgw_res::v3::CheckResponse>,
+                  public Logger::Loggable<Logger::Id::filter> {
+public:
+  ResWarmup(const Grpc::RawAsyncClientSharedPtr& async_client,
+            std::chrono::milliseconds retry_interval, const ResWarmupStatsSharedPtr& stats,
+            Event::Dispatcher& dispatcher);
+  ~ResWarmup() override;
+
+  static ResWarmupStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+  bool warm() const { return warm_; }
+
+  // Grpc::AsyncRequestCallbacks
+  void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+  void onSuccess(std::unique_ptr<envoy::service::mgw_res::v3::CheckResponse>&&,
+                 Tracing::Span&) override;
+  void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                 Tracing::Span&) override;
+
+private:
+  void probe();
+  void setWarm();
+
+  const Protobuf::MethodDescriptor& service_method_;
+  Grpc::AsyncClient<envoy::service::mgw_res::v3::CheckRequestBatch,
+                    envoy::service::mgw_res::v3::CheckResponse>
+      async_client_;
+  const std::chrono::milliseconds retry_interval_;
+  ResWarmupStatsSharedPtr stats_;
+  Event::TimerPtr retry_timer_;
+  Grpc::AsyncRequest* request_{};
+  bool warm_{};
+};
+
+using ResWarmupPtr = std::unique_ptr<ResWarmup>;
+
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,13 +1,18 @@
 #include "mgw-source/filters/http/mgw/analytics.h"
 
+#include <algorithm>
+
 #include "envoy/config/core/v3/base.pb.h"
 
 #include "common/common/assert.h"
+#include "common/common/empty_string.h"
 #include "common/common/enum_to_int.h"
 #include "common/http/utility.h"
 #include "common/router/config_impl.h"
 
 #include "extensions/filters/http/well_known_names.h"
+
+#include "absl/strings/str_cat.h"
 // #include "mgw-source/filters/common/mgw/check_response_utils.h"
 
 namespace Envoy {
@@ -15,15 +20,109 @@ namespace Extensions {
 namespace HttpFilters {
 namespace MGW {
 
+namespace {
+
+uint64_t toNanos(const absl::optional<std::chrono::nanoseconds>& duration) {
+  return duration.has_value() ? duration.value().count() : 0;
+}
+
+std::chrono::milliseconds elapsedSince(Event::Dispatcher& dispatcher, MonotonicTime start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      dispatcher.timeSource().monotonicTime() - start);
+}
+
+Http::HeaderMap::Iterate copyHeader(const Http::HeaderEntry& header, void* context) {
+  auto* headers = static_cast<Protobuf::Map<std::string, std::string>*>(context);
+  std::string key(header.key().getStringView());
+  std::string& value = (*headers)[key];
+  if (value.empty()) {
+    value = std::string(header.value().getStringView());
+  } else {
+    // Repeated headers are joined the way an intermediary would fold them.
+    absl::StrAppend(&value, ",", header.value().getStringView());
+  }
+  return Http::HeaderMap::Iterate::Continue;
+}
+
+} // namespace
 
 // Http::StreamFilterBase
 void Filter::onDestroy() {
   ENVOY_STREAM_LOG(trace, "[SIGH] filter destroyed", *res_callbacks_);
-  // if (res_state_ == State::Calling) {
-  //   res_state_ = State::Complete;
-  //   res_client_->cancel();
-  // }
+  if (req_state_ == State::Calling) {
+    req_state_ = State::Complete;
+    req_client_->cancel();
+    res_config_->stats().intercept_active_.dec();
+    res_config_->stats().intercept_cancelled_.inc();
+    res_config_->stats().decode_paused_time_.recordValue(
+        elapsedSince(req_callbacks_->dispatcher(), req_call_start_).count());
+  }
+  if (res_state_ != State::Calling) {
+    return;
+  }
+  if (observeOnly()) {
+    // The stream went away before the response was fully encoded. Report what we have.
+    completeObservation(true);
+    return;
+  }
+  res_state_ = State::Complete;
+  res_client_->cancel();
+  Filters::Common::MGW::CallLimiter* limiter = res_config_->callLimiter();
+  if (limiter != nullptr) {
+    limiter->onCallCancelled(res_admission_);
+  }
+  res_config_->stats().intercept_active_.dec();
+  res_config_->stats().intercept_cancelled_.inc();
+  res_config_->stats().encode_paused_time_.recordValue(
+      elapsedSince(res_callbacks_->dispatcher(), res_call_start_).count());
+}
+
+// Http::StreamDecoderFilter
+Http::FilterHeadersStatus Filter::decodeHeaders(Http::RequestHeaderMap& headers, bool) {
+  if (req_client_ == nullptr) {
+    return Http::FilterHeadersStatus::Continue;
+  }
+  const FilterConfigPerRoute* per_route = FilterConfig::perRouteConfig(req_callbacks_->route());
+  if (per_route != nullptr && per_route->disabled()) {
+    return Http::FilterHeadersStatus::Continue;
+  }
+
+  Filters::Common::MGW::ReqDecisionCache* cache = res_config_->reqCache();
+  if (cache != nullptr) {
+    buildCacheKey(headers);
+    const Filters::Common::MGW::CachedDecision* decision = cache->lookup(req_cache_key_);
+    if (decision != nullptr) {
+      req_state_ = State::Complete;
+      if (decision->status_ == Filters::Common::MGW::CheckStatus::OK) {
+        res_config_->stats().ok_.inc();
+        res_config_->incClusterCounter(req_callbacks_->clusterInfo(), res_config_->mgw_ok_);
+        return Http::FilterHeadersStatus::Continue;
+      }
+      res_config_->stats().denied_.inc();
+      res_config_->incClusterCounter(req_callbacks_->clusterInfo(), res_config_->mgw_denied_);
+      rejectRequest(decision->status_code_, decision->body_, RcDetails::get().MGWDenied);
+      return Http::FilterHeadersStatus::StopIteration;
+    }
+  }
+
+  initiateRequestInterceptCall(headers);
+  return request_filter_return_ == RequestFilterReturn::StopDecoding
+             ? Http::FilterHeadersStatus::StopAllIterationAndWatermark
+             : Http::FilterHeadersStatus::Continue;
+}
+
+// The body is not sent to the service. While a call is in flight StopAllIterationAndWatermark
+// holds the data back, so there is nothing to do here.
+Http::FilterDataStatus Filter::decodeData(Buffer::Instance&, bool) {
+  return Http::FilterDataStatus::Continue;
+}
+
+Http::FilterTrailersStatus Filter::decodeTrailers(Http::RequestTrailerMap&) {
+  return Http::FilterTrailersStatus::Continue;
 }
+
+void Filter::setDecoderFilterCallbacks(Http::StreamDecoderFilterCallbacks& callbacks) {
+  req_callbacks_ = &callbacks;
 }
 
 // Http::StreamEncoderFilter
@@ -31,8 +130,85 @@ Http::FilterHeadersStatus Filter::encode100ContinueHeaders(Http::ResponseHeaderM
   return Http::FilterHeadersStatus::Continue;
 }
 
-Http::FilterHeadersStatus Filter::encodeHeaders(Http::ResponseHeaderMap& , bool) {
-  Router::RouteConstSharedPtr route = res_callbacks_->route();
+Http::FilterHeadersStatus Filter::encodeHeaders(Http::ResponseHeaderMap& headers,
+                                                bool end_stream) {
+  if (local_reply_) {
+    // Our own rejection of the request is not a response of the upstream to intercept.
+    return Http::FilterHeadersStatus::Continue;
+  }
+  const FilterConfigPerRoute* per_route = FilterConfig::perRouteConfig(res_callbacks_->route());
+  if (per_route != nullptr && per_route->disabled()) {
+    // Nothing is built, sent or counted for this stream; res_state_ stays NotStarted.
+    return Http::FilterHeadersStatus::Continue;
+  }
+  if (!res_config_->sampled(per_route)) {
+    // Nothing is built or sent for this stream; res_state_ stays NotStarted.
+    res_config_->stats().unsampled_.inc();
+    return Http::FilterHeadersStatus::Continue;
+  }
+  res_config_->stats().sampled_.inc();
+  response_code_ = static_cast<uint32_t>(Http::Utility::getResponseStatus(headers));
+  response_headers_ = &headers;
+  mode_ = per_route != nullptr && per_route->mode().has_value() ? per_route->mode().value()
+                                                                : res_config_->mode();
+
+  if (observeOnly()) {
+    // The response is never held. The event is published or rolled up once the response is
+    // complete, so that it carries the full timing.
+    res_state_ = State::Calling;
+    if (end_stream) {
+      completeObservation(false);
+    }
+    return Http::FilterHeadersStatus::Continue;
+  }
+
+  const ResponseRules& rules = res_config_->responseRules();
+  if (!rules.empty()) {
+    const Router::RouteEntry* route_entry = res_callbacks_->streamInfo().routeEntry();
+    const absl::optional<Filters::Common::MGW::CheckStatus> outcome = rules.evaluate(
+        response_code_, route_entry != nullptr ? route_entry->routeName() : EMPTY_STRING, headers);
+    if (outcome.has_value()) {
+      ENVOY_STREAM_LOG(trace, "mgw filter decided the response with a local rule",
+                       *res_callbacks_);
+      res_config_->stats().rule_matched_.inc();
+      res_state_ = State::Complete;
+      countResponseDecision(outcome.value());
+      return Http::FilterHeadersStatus::Continue;
+    }
+    res_config_->stats().rule_fallback_.inc();
+  }
+
+  timeout_ = per_route != nullptr && per_route->timeout().has_value()
+                 ? per_route->timeout().value()
+                 : res_config_->timeout();
+  if (!applyDeadline()) {
+    // So little of the route timeout is left that the call would only delay the response.
+    ENVOY_STREAM_LOG(trace, "mgw filter skipped the intercept call, deadline too close",
+                     *res_callbacks_);
+    res_config_->stats().deadline_skipped_.inc();
+    res_config_->stats().failure_mode_allowed_.inc();
+    res_config_->incClusterCounter(res_callbacks_->clusterInfo(),
+                                   res_config_->mgw_failure_mode_allowed_);
+    return Http::FilterHeadersStatus::Continue;
+  }
+
+  Filters::Common::MGW::CallLimiter* limiter = res_config_->callLimiter();
+  if (limiter != nullptr) {
+    res_admission_ = limiter->tryAdmit();
+  }
+  if (res_admission_ == Filters::Common::MGW::CallLimiter::Admission::Rejected) {
+    // Over the limit or the breaker is open: let the response through without a call.
+    ENVOY_STREAM_LOG(trace, "mgw filter skipped the intercept call, limit reached",
+                     *res_callbacks_);
+    res_config_->stats().failure_mode_allowed_.inc();
+    res_config_->incClusterCounter(res_callbacks_->clusterInfo(),
+                                   res_config_->mgw_failure_mode_allowed_);
+    return Http::FilterHeadersStatus::Continue;
+  }
+  if (res_client_ == nullptr) {
+    // Made per call rather than per stream, so streams that skip the call don't pay for it.
+    res_client_ = res_config_->createResClient(timeout_);
+  }
 
   // Initiate a call to the authorization server since we are not disabled.
   initiateResponseInterceptCall();
@@ -42,12 +218,21 @@ Http::FilterHeadersStatus Filter::encodeHeaders(Http::ResponseHeaderMap& , bool)
              : Http::FilterHeadersStatus::Continue;
 }
 
-Http::FilterDataStatus Filter::encodeData(Buffer::Instance& , bool ) {
-  ENVOY_LOG(info, "[woohoo] inside encode data");
+Http::FilterDataStatus Filter::encodeData(Buffer::Instance& data, bool end_stream) {
+  if (res_state_ == State::Calling && capturesBody()) {
+    captureBody(data);
+  }
+  response_bytes_ += data.length();
+  if (end_stream && res_state_ == State::Calling && observeOnly()) {
+    completeObservation(false);
+  }
   return Http::FilterDataStatus::Continue;
 }
 
 Http::FilterTrailersStatus Filter::encodeTrailers(Http::ResponseTrailerMap&) {
+  if (res_state_ == State::Calling && observeOnly()) {
+    completeObservation(false);
+  }
   return Http::FilterTrailersStatus::Continue;
 }
 
@@ -63,16 +248,46 @@ void Filter::setEncoderFilterCallbacks(Http::StreamEncoderFilterCallbacks& callb
 void Filter::onResponseComplete(Filters::Common::MGW::ResponsePtr&& response) {
   res_state_ = State::Complete;
   using Filters::Common::MGW::CheckStatus;
-  // Stats::StatName empty_stat_name;
+  const std::chrono::milliseconds latency =
+      elapsedSince(res_callbacks_->dispatcher(), res_call_start_);
+  res_config_->stats().intercept_active_.dec();
+  res_config_->stats().response_intercept_latency_.recordValue(latency.count());
+  if (!initiating_responce_call_) {
+    res_config_->stats().encode_paused_time_.recordValue(latency.count());
+  }
+  Filters::Common::MGW::CallLimiter* limiter = res_config_->callLimiter();
+  if (limiter != nullptr) {
+    limiter->onCallComplete(res_admission_, latency, response->status == CheckStatus::Error);
+  }
+  Filters::Common::MGW::AdaptiveTimeout* adaptive = res_config_->adaptiveTimeout();
+  if (adaptive != nullptr &&
+      (response->status != CheckStatus::Error || latency >= adaptive->timeout())) {
+    // Other failures, including calls cut short by the route deadline, say little about how long
+    // an answer takes.
+    adaptive->onCallComplete(latency);
+  }
+
   switch (response->status) {
   case CheckStatus::OK: {
-    std::cout << "response 64" << std::endl;
     ENVOY_STREAM_LOG(trace, "mgw analytics filter successfully sent data to filter chain", *res_callbacks_);
+    countResponseDecision(CheckStatus::OK);
+    break;
+  }
+
+  case CheckStatus::Denied: {
+    ENVOY_STREAM_LOG(trace, "mgw response interceptor denied the response", *res_callbacks_);
+    countResponseDecision(CheckStatus::Denied);
     break;
   }
 
   case CheckStatus::Error: {
-    std::cout << "response 71" << std::endl;
+    res_config_->stats().error_.inc();
+    res_config_->incClusterCounter(res_callbacks_->clusterInfo(), res_config_->mgw_error_);
+    // The async client reports a timeout like any other failure, so it is told apart by the time
+    // the call took.
+    if (latency >= timeout_) {
+      res_config_->stats().intercept_timeout_.inc();
+    }
     // ENVOY_STREAM_LOG(trace,
     //                   "mgw filter rejected the request with an error. Response status code: {}",
     //                   *res_callbacks_, enumToInt(res_config_->statusOnError()));
@@ -84,22 +299,281 @@ void Filter::onResponseComplete(Filters::Common::MGW::ResponsePtr&& response) {
     //                                RcDetails::get().AuthzError);
     break;
   }
-  default:
-    std::cout << "response 499" << std::endl;
-    NOT_REACHED_GCOVR_EXCL_LINE;
-    break;
   }
   continueEncoding();
 }
 
+// MGW::RequestCallbacks
+void Filter::onRequestComplete(Filters::Common::MGW::ResponsePtr&& response) {
+  req_state_ = State::Complete;
+  using Filters::Common::MGW::CheckStatus;
+  const std::chrono::milliseconds latency =
+      elapsedSince(req_callbacks_->dispatcher(), req_call_start_);
+  res_config_->stats().intercept_active_.dec();
+  res_config_->stats().request_intercept_latency_.recordValue(latency.count());
+  if (!initiating_request_call_) {
+    res_config_->stats().decode_paused_time_.recordValue(latency.count());
+  }
+
+  Filters::Common::MGW::ReqDecisionCache* cache = res_config_->reqCache();
+  if (cache != nullptr) {
+    cache->insert(req_cache_key_, *response);
+  }
+
+  switch (response->status) {
+  case CheckStatus::OK:
+    ENVOY_STREAM_LOG(trace, "mgw filter accepted the request", *req_callbacks_);
+    res_config_->stats().ok_.inc();
+    res_config_->incClusterCounter(req_callbacks_->clusterInfo(), res_config_->mgw_ok_);
+    continueDecoding();
+    break;
+  case CheckStatus::Denied:
+    ENVOY_STREAM_LOG(trace, "mgw filter rejected the request. Response status code: {}",
+                     *req_callbacks_, enumToInt(response->status_code));
+    res_config_->stats().denied_.inc();
+    res_config_->incClusterCounter(req_callbacks_->clusterInfo(), res_config_->mgw_denied_);
+    rejectRequest(response->status_code, response->body, RcDetails::get().MGWDenied);
+    break;
+  case CheckStatus::Error:
+    res_config_->stats().error_.inc();
+    res_config_->incClusterCounter(req_callbacks_->clusterInfo(), res_config_->mgw_error_);
+    if (latency >= res_config_->requestTimeout()) {
+      res_config_->stats().intercept_timeout_.inc();
+    }
+    if (res_config_->failureModeAllow()) {
+      ENVOY_STREAM_LOG(trace, "mgw filter allowed the request with an error", *req_callbacks_);
+      res_config_->stats().failure_mode_allowed_.inc();
+      res_config_->incClusterCounter(req_callbacks_->clusterInfo(),
+                                     res_config_->mgw_failure_mode_allowed_);
+      continueDecoding();
+    } else {
+      ENVOY_STREAM_LOG(trace, "mgw filter rejected the request with an error", *req_callbacks_);
+      rejectRequest(Http::Code::Forbidden, EMPTY_STRING, RcDetails::get().MGWError);
+    }
+    break;
+  }
+}
+
+void Filter::initiateRequestInterceptCall(const Http::RequestHeaderMap& headers) {
+  request_filter_return_ = RequestFilterReturn::StopDecoding;
+  ENVOY_STREAM_LOG(trace, "mgw filter calling request interceptor server", *req_callbacks_);
+  req_state_ = State::Calling;
+  buildRequestInterceptRequest(headers);
+  req_call_start_ = req_callbacks_->dispatcher().timeSource().monotonicTime();
+  res_config_->stats().intercept_active_.inc();
+  // If the client completes inline, onRequestComplete() must not resume decoding on the stack.
+  initiating_request_call_ = true;
+  req_client_->intercept(*this, req_intercept_request_, req_callbacks_->activeSpan(),
+                         req_callbacks_->streamInfo());
+  initiating_request_call_ = false;
+}
+
+void Filter::buildRequestInterceptRequest(const Http::RequestHeaderMap& headers) {
+  auto* http = req_intercept_request_.mutable_attributes()->mutable_request()->mutable_http();
+  http->set_method(std::string(headers.getMethodValue()));
+  http->set_path(std::string(headers.getPathValue()));
+  http->set_host(std::string(headers.getHostValue()));
+  http->set_scheme(std::string(headers.getSchemeValue()));
+  if (req_callbacks_->streamInfo().protocol().has_value()) {
+    http->set_protocol(
+        Http::Utility::getProtocolString(req_callbacks_->streamInfo().protocol().value()));
+  }
+  headers.iterate(copyHeader, http->mutable_headers());
+}
+
+void Filter::buildCacheKey(const Http::RequestHeaderMap& headers) {
+  for (const Http::LowerCaseString& name : res_config_->cacheKeyHeaders()) {
+    const Http::HeaderEntry* header = headers.get(name);
+    // Tells a missing header from one with an empty value.
+    req_cache_key_.push_back(header != nullptr ? '\1' : '\2');
+    if (header != nullptr) {
+      absl::StrAppend(&req_cache_key_, header->value().getStringView());
+    }
+    // Separates the values so that moving bytes between headers changes the key. Header values
+    // never contain NUL.
+    req_cache_key_.push_back('\0');
+  }
+}
+
+void Filter::continueDecoding() {
+  request_filter_return_ = RequestFilterReturn::ContinueDecoding;
+  if (!initiating_request_call_) {
+    req_callbacks_->continueDecoding();
+  }
+}
+
+void Filter::rejectRequest(Http::Code status_code, const std::string& body,
+                           const std::string& details) {
+  req_callbacks_->streamInfo().setResponseFlag(
+      StreamInfo::ResponseFlag::UnauthorizedExternalService);
+  // The reply is encoded by this filter too, before sendLocalReply() returns.
+  local_reply_ = true;
+  req_callbacks_->sendLocalReply(status_code, body, nullptr, absl::nullopt, details);
+}
+
 void Filter::initiateResponseInterceptCall() {
   response_filter_return_ = ResponseFilterReturn::StopEncoding;
-  Router::RouteConstSharedPtr route = res_callbacks_->route();
 
   ENVOY_STREAM_LOG(trace, "mgw filter calling response interceptor server", *res_callbacks_);
   res_state_ = State::Calling;
+  buildInterceptRequest(res_intercept_request_);
+  res_config_->stats().intercept_request_size_.recordValue(res_intercept_request_.ByteSizeLong());
+  res_call_start_ = res_callbacks_->dispatcher().timeSource().monotonicTime();
+  res_config_->stats().intercept_active_.inc();
+  // If the client completes inline, onResponseComplete() must not resume encoding on the stack.
+  initiating_responce_call_ = true;
   res_client_->intercept(*this, res_intercept_request_, res_callbacks_->activeSpan(),
                          res_callbacks_->streamInfo());
+  initiating_responce_call_ = false;
+}
+
+bool Filter::applyDeadline() {
+  Filters::Common::MGW::AdaptiveTimeout* adaptive = res_config_->adaptiveTimeout();
+  if (adaptive != nullptr) {
+    timeout_ = std::min(timeout_, adaptive->timeout());
+  }
+  const absl::optional<std::chrono::milliseconds>& min_remaining =
+      res_config_->deadlineMinRemaining();
+  if (!min_remaining.has_value()) {
+    return true;
+  }
+  const StreamInfo::StreamInfo& stream_info = res_callbacks_->streamInfo();
+  const Router::RouteEntry* route_entry = stream_info.routeEntry();
+  if (route_entry == nullptr || route_entry->timeout().count() == 0) {
+    return true;
+  }
+  const std::chrono::milliseconds remaining =
+      route_entry->timeout() - elapsedSince(res_callbacks_->dispatcher(),
+                                            stream_info.startTimeMonotonic());
+  if (remaining < min_remaining.value()) {
+    return false;
+  }
+  timeout_ = std::min(timeout_, remaining);
+  return true;
+}
+
+void Filter::countResponseDecision(Filters::Common::MGW::CheckStatus status) {
+  // The response path only observes, so a denial is counted but leaves the response as is.
+  if (status == Filters::Common::MGW::CheckStatus::Denied) {
+    res_config_->stats().denied_.inc();
+    res_config_->incClusterCounter(res_callbacks_->clusterInfo(), res_config_->mgw_denied_);
+    return;
+  }
+  res_config_->stats().ok_.inc();
+  res_config_->incClusterCounter(res_callbacks_->clusterInfo(), res_config_->mgw_ok_);
+}
+
+void Filter::completeObservation(bool reset) {
+  res_state_ = State::Complete;
+  if (mode_ == envoy::extensions::filters::http::mgw::v3::MGW::AGGREGATE) {
+    recordRollup();
+    return;
+  }
+  if (res_config_->tailSampling()) {
+    // Decided on the status and timing kept by the filter, the request is only built for events
+    // that are kept. A reset stream is an outlier whatever those say.
+    if (!reset && !res_config_->tailSampled(
+                      response_code_,
+                      elapsedSince(res_callbacks_->dispatcher(),
+                                   res_callbacks_->streamInfo().startTimeMonotonic()))) {
+      res_config_->stats().tail_dropped_.inc();
+      return;
+    }
+    res_config_->stats().tail_kept_.inc();
+  }
+  publishInterceptRequest();
+}
+
+void Filter::publishInterceptRequest() {
+  ENVOY_STREAM_LOG(trace, "mgw filter publishing to response interceptor server",
+                   *res_callbacks_);
+  envoy::service::mgw_res::v3::CheckRequest& request = res_config_->publishRequest();
+  buildInterceptRequest(request);
+  res_config_->stats().intercept_request_size_.recordValue(request.ByteSizeLong());
+  res_config_->publisher(res_callbacks_->dispatcher()).publish(request);
+}
+
+void Filter::recordRollup() {
+  const StreamInfo::StreamInfo& stream_info = res_callbacks_->streamInfo();
+  absl::string_view route_name;
+  absl::string_view cluster_name;
+  const Router::RouteEntry* route_entry = stream_info.routeEntry();
+  if (route_entry != nullptr) {
+    route_name = route_entry->routeName();
+    cluster_name = route_entry->clusterName();
+  }
+  const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      res_callbacks_->dispatcher().timeSource().monotonicTime() -
+      stream_info.startTimeMonotonic());
+  res_config_->rollups().record(route_name, cluster_name, response_code_ / 100,
+                                stream_info.bytesReceived(), response_bytes_, latency.count());
+}
+
+void Filter::captureBody(const Buffer::Instance& data) {
+  if (response_body_truncated_) {
+    return;
+  }
+  const uint64_t limit = res_config_->bodyCaptureBytes();
+  if (response_body_.capacity() < limit) {
+    // Reserving the limit up front keeps the string from growing past it.
+    response_body_.reserve(limit);
+  }
+  const uint64_t length = std::min<uint64_t>(data.length(), limit - response_body_.size());
+  if (length < data.length()) {
+    response_body_truncated_ = true;
+    res_config_->stats().body_truncated_.inc();
+  }
+  if (length == 0) {
+    return;
+  }
+  // A single copy of the needed prefix. The buffer itself is neither linearized nor drained.
+  const size_t offset = response_body_.size();
+  response_body_.resize(offset + length);
+  data.copyOut(0, length, &response_body_[offset]);
+}
+
+void Filter::buildInterceptRequest(envoy::service::mgw_res::v3::CheckRequest& request) {
+  const StreamInfo::StreamInfo& stream_info = res_callbacks_->streamInfo();
+
+  request.set_response_code(response_code_);
+  const Http::RequestHeaderMap* request_headers = stream_info.getRequestHeaders();
+  if (request_headers != nullptr) {
+    request.set_request_id(std::string(request_headers->getRequestIdValue()));
+  }
+  const Router::RouteEntry* route_entry = stream_info.routeEntry();
+  if (route_entry != nullptr) {
+    request.set_route_name(route_entry->routeName());
+    request.set_cluster_name(route_entry->clusterName());
+  }
+  request.set_upstream_connect_ns(toNanos(stream_info.firstUpstreamTxByteSent()));
+  request.set_upstream_first_byte_ns(toNanos(stream_info.firstUpstreamRxByteReceived()));
+  request.set_upstream_last_byte_ns(toNanos(stream_info.lastUpstreamRxByteReceived()));
+  request.set_request_bytes(stream_info.bytesReceived());
+  request.set_response_bytes(response_bytes_);
+  if (capturesBody()) {
+    // Built once, when the response is complete, so the capture can be handed over.
+    request.set_response_body(std::move(response_body_));
+    request.set_response_body_truncated(response_body_truncated_);
+  }
+  projectHeaders(request);
+}
+
+void Filter::projectHeaders(envoy::service::mgw_res::v3::CheckRequest& request) {
+  // One lookup per configured header, so the cost doesn't depend on the size of the response.
+  for (const ProjectedHeader& projected : res_config_->projectedHeaders()) {
+    const Http::HeaderEntry* header = response_headers_->get(projected.name_);
+    if (header == nullptr) {
+      continue;
+    }
+    absl::string_view value = header->value().getStringView();
+    if (value.size() > projected.max_value_bytes_) {
+      value = value.substr(0, projected.max_value_bytes_);
+      res_config_->stats().header_truncated_.inc();
+    }
+    auto* response_header = request.add_response_headers();
+    response_header->set_name(projected.name_.get());
+    response_header->set_value(value.data(), value.size());
+  }
 }
 
 void Filter::continueEncoding() {
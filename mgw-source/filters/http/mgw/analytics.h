@@ -1,11 +1,13 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "mgw-api/extensions/filters/http/mgw/v3/mgw.pb.h"
+#include "envoy/common/time.h"
 #include "envoy/http/filter.h"
 #include "envoy/local_info/local_info.h"
 #include "envoy/runtime/runtime.h"
@@ -20,6 +22,7 @@
 #include "common/http/codes.h"
 #include "common/http/header_map_impl.h"
 #include "common/runtime/runtime_protos.h"
+#include "common/singleton/const_singleton.h"
 
 #include "mgw-source/filters/common/mgw/mgw.h"
 #include "mgw-source/filters/http/mgw/filter_config.h"
@@ -31,20 +34,41 @@ namespace MGW {
 
 using FilterConfigSharedPtr = std::shared_ptr<FilterConfig>;
 
+/**
+ * Response details set on local replies of the request path.
+ */
+struct RcDetailsValues {
+  // The request interception service denied the request.
+  const std::string MGWDenied = "mgw_denied";
+  // The request interception service could not be reached.
+  const std::string MGWError = "mgw_error";
+};
+using RcDetails = ConstSingleton<RcDetailsValues>;
+
 /**
  * HTTP mgw filter. Depending on the route configuration, this filter calls the global
  * mgw service before allowing further filter iteration.
  */
 class Filter : public Logger::Loggable<Logger::Id::filter>,
-               public Http::StreamEncoderFilter,
-               public Filters::Common::MGW::ResponseCallbacks {
+               public Http::StreamFilter,
+               public Filters::Common::MGW::ResponseCallbacks,
+               public Filters::Common::MGW::RequestCallbacks {
 public:
-  Filter(const FilterConfigSharedPtr& res_config, Filters::Common::MGW::ResClientPtr&& res_client)
-      : res_config_(res_config), res_client_(std::move(res_client)) {}
+  // res_client may be null, a client is then made when a sync mode call starts.
+  Filter(const FilterConfigSharedPtr& res_config, Filters::Common::MGW::ResClientPtr&& res_client,
+         Filters::Common::MGW::ReqClientPtr&& req_client)
+      : res_config_(res_config), res_client_(std::move(res_client)),
+        req_client_(std::move(req_client)) {}
 
   // Http::StreamFilterBase
   void onDestroy() override;
 
+  // Http::StreamDecoderFilter
+  Http::FilterHeadersStatus decodeHeaders(Http::RequestHeaderMap&, bool) override;
+  Http::FilterDataStatus decodeData(Buffer::Instance&, bool) override;
+  Http::FilterTrailersStatus decodeTrailers(Http::RequestTrailerMap&) override;
+  void setDecoderFilterCallbacks(Http::StreamDecoderFilterCallbacks&) override;
+
   // Http::StreamEncoderFilter
   Http::FilterHeadersStatus encode100ContinueHeaders(Http::ResponseHeaderMap&) override;
   Http::FilterHeadersStatus encodeHeaders(Http::ResponseHeaderMap&, bool) override;
@@ -56,6 +80,9 @@ public:
   // MGW::ResponseCallbacks
   void onResponseComplete(Filters::Common::MGW::ResponsePtr&&) override;
 
+  // MGW::RequestCallbacks
+  void onRequestComplete(Filters::Common::MGW::ResponsePtr&&) override;
+
 private:
   void continueEncoding();
   // State of this filter's communication with the external decode/encode service.
@@ -65,6 +92,29 @@ private:
 
   ////// response path members
   void initiateResponseInterceptCall();
+  // Narrows timeout_ to the adaptive timeout and to what is left of the route timeout.
+  // @return false if too little of the route timeout is left for a call.
+  bool applyDeadline();
+  // Counts an OK or Denied decision, whether it came from the service or a local rule.
+  void countResponseDecision(Filters::Common::MGW::CheckStatus status);
+  // Observe-only modes never hold the response.
+  bool observeOnly() const { return mode_ != envoy::extensions::filters::http::mgw::v3::MGW::SYNC; }
+  // Only async mode sends the body, the other modes are done before it or never send events.
+  bool capturesBody() const {
+    return mode_ == envoy::extensions::filters::http::mgw::v3::MGW::ASYNC &&
+           res_config_->bodyCaptureBytes() > 0;
+  }
+  // Observe-only modes: called once when the response is complete or, with reset set, when the
+  // stream goes away first.
+  void completeObservation(bool reset);
+  // Async mode: fills the request and hands it to the worker's publisher.
+  void publishInterceptRequest();
+  // Aggregate mode: adds the response to the worker's rollups.
+  void recordRollup();
+  // Fills the request from the stream info and what has been encoded so far.
+  void buildInterceptRequest(envoy::service::mgw_res::v3::CheckRequest& request);
+  // Copies the configured response headers into the request.
+  void projectHeaders(envoy::service::mgw_res::v3::CheckRequest& request);
   // FilterReturn is used to capture what the return code should be to the filter chain.
   // if this filter is either in the middle of calling the service or the result is denied then
   // the filter chain should stop. Otherwise the filter chain can continue to the next filter.
@@ -74,9 +124,53 @@ private:
   Filters::Common::MGW::ResClientPtr res_client_;
   Http::StreamEncoderFilterCallbacks* res_callbacks_{};
   State res_state_{State::NotStarted}; //state of response interceptor service
+  // The filter's mode unless the route overrides it.
+  Mode mode_{envoy::extensions::filters::http::mgw::v3::MGW::SYNC};
+  // Timeout of the sync mode call, the filter's unless the route overrides it.
+  std::chrono::milliseconds timeout_{};
   // Used to identify if the response callback to onComplete() is synchronous (on the stack) or asynchronous.
   bool initiating_responce_call_{};
+  // Sync mode only, async mode builds in the worker's request. @see FilterConfig::publishRequest()
   envoy::service::mgw_res::v3::CheckRequest res_intercept_request_{};
+  // Start of the sync mode intercept call.
+  MonotonicTime res_call_start_;
+  // How the call limiter let the sync mode call through, handed back when the call ends.
+  Filters::Common::MGW::CallLimiter::Admission res_admission_{
+      Filters::Common::MGW::CallLimiter::Admission::Admitted};
+  // Status code of the response headers.
+  uint32_t response_code_{};
+  // Owned by the stream, which outlives the filter. Set once the response is sampled.
+  const Http::ResponseHeaderMap* response_headers_{};
+  // Response body bytes encoded so far.
+  uint64_t response_bytes_{};
+  // Copies the start of a body chunk into response_body_ until the capture limit is reached.
+  void captureBody(const Buffer::Instance& data);
+  // Start of the response body. Capacity never exceeds the configured capture limit.
+  std::string response_body_;
+  bool response_body_truncated_{};
+
+  ////// request path members
+  void initiateRequestInterceptCall(const Http::RequestHeaderMap& headers);
+  // Fills req_intercept_request_ from the request headers and the stream info.
+  void buildRequestInterceptRequest(const Http::RequestHeaderMap& headers);
+  // Joins the values of the configured key headers into req_cache_key_.
+  void buildCacheKey(const Http::RequestHeaderMap& headers);
+  void continueDecoding();
+  void rejectRequest(Http::Code status_code, const std::string& body, const std::string& details);
+  enum class RequestFilterReturn { ContinueDecoding, StopDecoding };
+  RequestFilterReturn request_filter_return_{RequestFilterReturn::ContinueDecoding};
+  Filters::Common::MGW::ReqClientPtr req_client_;
+  Http::StreamDecoderFilterCallbacks* req_callbacks_{};
+  State req_state_{State::NotStarted}; // state of request interceptor service
+  // Used to identify if the callback to onRequestComplete() is synchronous (on the stack) or
+  // asynchronous.
+  bool initiating_request_call_{};
+  envoy::service::auth::v3::CheckRequest req_intercept_request_{};
+  MonotonicTime req_call_start_;
+  // Empty unless the decision cache is enabled.
+  std::string req_cache_key_;
+  // Set once this filter rejected the request, so that its local reply is not intercepted.
+  bool local_reply_{};
 };
 
 } // namespace MGW
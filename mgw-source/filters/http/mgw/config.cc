@@ -10,7 +10,7 @@
 
 #include "common/protobuf/utility.h"
 
-#include "mgw-source/filters/common/mgw/mgw_res_grpc_impl.h"
+#include "mgw-source/filters/common/mgw/mgw_req_grpc_impl.h"
 #include "mgw-source/filters/http/mgw/analytics.h"
 
 namespace Envoy {
@@ -21,27 +21,39 @@ namespace MGW {
 Http::FilterFactoryCb MGWFilterConfig::createFilterFactoryFromProtoTyped(
     const envoy::extensions::filters::http::mgw::v3::MGW& proto_config,
     const std::string& stats_prefix, Server::Configuration::FactoryContext& context) {
-  const auto res_filter_config =
-      std::make_shared<FilterConfig>(proto_config, context.localInfo(), context.scope(),
-                                     context.runtime(), context.httpContext(), stats_prefix);
-  Http::FilterFactoryCb callback;
-
   const uint32_t res_timeout_ms =
       PROTOBUF_GET_MS_OR_DEFAULT(proto_config.grpc_service(), timeout, DefaultTimeout);
-  callback = [res_grpc_service = proto_config.grpc_service(), &context,
-                res_filter_config, res_timeout_ms](Http::FilterChainFactoryCallbacks& callbacks) {
-    const auto res_async_client_factory =
-        context.clusterManager().grpcAsyncClientManager().factoryForGrpcService(
-            res_grpc_service, context.scope(), true);
-    auto res_client = std::make_unique<Filters::Common::MGW::GrpcResClientImpl>(
-        res_async_client_factory->create(), std::chrono::milliseconds(res_timeout_ms));
-    callbacks.addStreamEncoderFilter(Http::StreamEncoderFilterSharedPtr{std::make_shared<Filter>(
-         res_filter_config, std::move(res_client))});
+  const auto res_filter_config = std::make_shared<FilterConfig>(
+      proto_config, context.localInfo(), context.scope(), context.runtime(),
+      context.httpContext(), stats_prefix, context.threadLocal(),
+      context.clusterManager().grpcAsyncClientManager(), context.random(), context.dispatcher(),
+      std::chrono::milliseconds(res_timeout_ms));
+  Http::FilterFactoryCb callback;
+
+  callback = [res_filter_config](Http::FilterChainFactoryCallbacks& callbacks) {
+    // The response client is made by the filter once it knows the route's mode, so streams that
+    // are observed, sampled out or disabled never create one.
+    if (!res_filter_config->interceptsRequests()) {
+      callbacks.addStreamEncoderFilter(Http::StreamEncoderFilterSharedPtr{
+          std::make_shared<Filter>(res_filter_config, nullptr, nullptr)});
+      return;
+    }
+    auto req_client = std::make_unique<Filters::Common::MGW::GrpcReqClientImpl>(
+        res_filter_config->reqAsyncClient(), res_filter_config->requestTimeout());
+    callbacks.addStreamFilter(Http::StreamFilterSharedPtr{std::make_shared<Filter>(
+        res_filter_config, nullptr, std::move(req_client))});
   };
 
   return callback;
 };
 
+Router::RouteSpecificFilterConfigConstSharedPtr
+MGWFilterConfig::createRouteSpecificFilterConfigTyped(
+    const envoy::extensions::filters::http::mgw::v3::MGWPerRoute& proto_config,
+    Server::Configuration::ServerFactoryContext& context, ProtobufMessage::ValidationVisitor&) {
+  return std::make_shared<const FilterConfigPerRoute>(proto_config, context.runtime());
+}
+
 /**
  * Static registration for the mgw filter. @see RegisterFactory.
  */
@@ -6,6 +6,8 @@
 #include "extensions/filters/http/common/factory_base.h"
 #include "extensions/filters/http/well_known_names.h"
 
+#include "mgw-source/filters/http/mgw/filter_config.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -15,15 +17,21 @@ namespace MGW {
  * Config registration for the external authorization filter. @see NamedHttpFilterConfigFactory.
  */
 class MGWFilterConfig
-    : public Common::FactoryBase<envoy::extensions::filters::http::mgw::v3::MGW> {
+    : public Common::FactoryBase<envoy::extensions::filters::http::mgw::v3::MGW,
+                                 envoy::extensions::filters::http::mgw::v3::MGWPerRoute> {
 public:
-  MGWFilterConfig() : FactoryBase("envoy.filters.http.mgw") {}
+  MGWFilterConfig() : FactoryBase(FilterConfig::filterName()) {}
 
 private:
   static constexpr uint64_t DefaultTimeout = 200;
   Http::FilterFactoryCb createFilterFactoryFromProtoTyped(
       const envoy::extensions::filters::http::mgw::v3::MGW& proto_config,
       const std::string& stats_prefix, Server::Configuration::FactoryContext& context) override;
+
+  Router::RouteSpecificFilterConfigConstSharedPtr createRouteSpecificFilterConfigTyped(
+      const envoy::extensions::filters::http::mgw::v3::MGWPerRoute& proto_config,
+      Server::Configuration::ServerFactoryContext& context,
+      ProtobufMessage::ValidationVisitor& validator) override;
 };
 
 } // namespace MGW
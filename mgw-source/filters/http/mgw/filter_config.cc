@@ -0,0 +1,532 @@
+#include "mgw-source/filters/http/mgw/filter_config.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "envoy/common/exception.h"
+
+#include "common/common/fmt.h"
+#include "common/http/utility.h"
+#include "common/protobuf/utility.h"
+
+#include "mgw-source/filters/common/mgw/mgw_res_batcher.h"
+#include "mgw-source/filters/common/mgw/mgw_res_grpc_impl.h"
+#include "mgw-source/filters/common/mgw/mgw_res_grpc_stream_impl.h"
+#include "mgw-source/filters/common/mgw/mgw_res_shm_publisher.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace MGW {
+
+namespace {
+
+constexpr uint32_t DefaultBatchMaxEvents = 100;
+constexpr uint32_t DefaultBatchMaxBytes = 64 * 1024;
+constexpr uint64_t DefaultBatchMaxLingerMs = 100;
+constexpr uint32_t DefaultBatchMaxPendingBatches = 16;
+constexpr uint64_t DefaultStreamBaseReconnectMs = 500;
+constexpr uint64_t DefaultAggregationIntervalMs = 10000;
+constexpr uint64_t DefaultRequestTimeoutMs = 200;
+constexpr uint64_t DefaultCacheTtlMs = 30000;
+constexpr uint32_t DefaultCacheMaxEntries = 1000;
+constexpr uint32_t DefaultCacheMaxEntryBytes = 2048;
+constexpr uint32_t DefaultAdaptiveMaxLimit = 1000;
+constexpr uint32_t DefaultAdaptiveMinLimit = 1;
+constexpr uint32_t DefaultCircuitConsecutiveErrors = 5;
+constexpr uint64_t DefaultCircuitOpenIntervalMs = 5000;
+constexpr uint32_t DefaultHedgeBudgetPercent = 5;
+constexpr uint64_t DefaultSpoolMaxBytes = 256 * 1024 * 1024;
+constexpr uint32_t DefaultSpoolSegmentBytes = 4 * 1024 * 1024;
+constexpr uint32_t DefaultSpoolReplayRate = 1000;
+constexpr uint32_t DefaultHeaderMaxValueBytes = 256;
+constexpr uint64_t DefaultDeadlineMinRemainingMs = 5;
+constexpr double DefaultAdaptivePercentile = 99;
+constexpr uint32_t DefaultAdaptiveHeadroomPercent = 50;
+constexpr uint64_t DefaultAdaptiveMinTimeoutMs = 10;
+constexpr uint32_t DefaultAdaptiveWindowCalls = 1000;
+constexpr uint32_t DefaultSingleFlightMaxWaiters = 100;
+constexpr uint32_t DefaultShmRingRecords = 4096;
+constexpr uint32_t DefaultShmRecordBytes = 1024;
+constexpr int64_t DefaultTailCodesStart = 500;
+constexpr int64_t DefaultTailCodesEnd = 600;
+constexpr uint64_t DefaultWarmupRetryIntervalMs = 1000;
+constexpr uint32_t DefaultMaxPendingPublishes = 1024;
+
+} // namespace
+
+FilterConfig::FilterConfig(const envoy::extensions::filters::http::mgw::v3::MGW& config,
+                           const LocalInfo::LocalInfo& local_info, Stats::Scope& scope,
+                           Runtime::Loader& runtime, Http::Context& http_context,
+                           const std::string& stats_prefix, ThreadLocal::SlotAllocator& tls,
+                           Grpc::AsyncClientManager& async_client_manager,
+                           Runtime::RandomGenerator& random, Event::Dispatcher& dispatcher,
+                           std::chrono::milliseconds timeout)
+    : local_info_(local_info), scope_(scope), runtime_(runtime), random_(random),
+      http_context_(http_context),
+      pool_(scope_.symbolTable()), stats_(generateStats(stats_prefix, scope)),
+      mgw_ok_(pool_.add("mgw.ok")), mgw_denied_(pool_.add("mgw.denied")),
+      mgw_error_(pool_.add("mgw.error")),
+      mgw_failure_mode_allowed_(pool_.add("mgw.failure_mode_allowed")), mode_(config.mode()),
+      timeout_(timeout),
+      sampling_(config.has_sampling()
+                    ? absl::make_optional<Runtime::FractionalPercent>(config.sampling(), runtime_)
+                    : absl::nullopt),
+      intercepts_requests_(config.has_request_interception()),
+      body_capture_bytes_(config.has_body_capture() ? config.body_capture().max_bytes() : 0),
+      response_rules_(config.response_rules()), tail_sampling_(config.has_tail_sampling()) {
+  // Names are lower cased here, so streams look headers up without building a key.
+  projected_headers_.reserve(config.response_headers_size());
+  for (const auto& header : config.response_headers()) {
+    projected_headers_.push_back(
+        {Http::LowerCaseString(header.name()),
+         PROTOBUF_GET_WRAPPED_OR_DEFAULT(header, max_value_bytes, DefaultHeaderMaxValueBytes)});
+  }
+
+  // The factory is resolved once here on the main thread. Each worker then creates its own client
+  // from it, which keeps the calls of a worker on that worker's dispatcher and saves the per
+  // stream factory lookup and client construction.
+  std::shared_ptr<Grpc::AsyncClientFactory> factory =
+      async_client_manager.factoryForGrpcService(config.grpc_service(), scope_, true);
+  factory_ = factory;
+  // Routes may override the mode, so publishers can be made whatever the filter's mode is.
+  ResPublisherFactory create_publisher = publisherFactory(config, stats_prefix, factory);
+  create_publisher_ = create_publisher;
+
+  std::shared_ptr<Grpc::AsyncClientFactory> req_factory;
+  absl::optional<Filters::Common::MGW::ReqCacheConfig> cache_config;
+  Filters::Common::MGW::ReqCacheStatsSharedPtr cache_stats;
+  if (intercepts_requests_) {
+    const auto& interception = config.request_interception();
+    req_factory =
+        async_client_manager.factoryForGrpcService(interception.grpc_service(), scope_, true);
+    request_timeout_ = std::chrono::milliseconds(
+        PROTOBUF_GET_MS_OR_DEFAULT(interception.grpc_service(), timeout, DefaultRequestTimeoutMs));
+    failure_mode_allow_ = interception.failure_mode_allow();
+    if (interception.has_cache()) {
+      const auto& cache = interception.cache();
+      for (const std::string& header : cache.key_headers()) {
+        cache_key_headers_.emplace_back(header);
+      }
+      cache_config = Filters::Common::MGW::ReqCacheConfig{
+          std::chrono::milliseconds(PROTOBUF_GET_MS_OR_DEFAULT(cache, ttl, DefaultCacheTtlMs)),
+          PROTOBUF_GET_WRAPPED_OR_DEFAULT(cache, max_entries, DefaultCacheMaxEntries),
+          PROTOBUF_GET_WRAPPED_OR_DEFAULT(cache, max_entry_bytes, DefaultCacheMaxEntryBytes)};
+      cache_stats = std::make_shared<Filters::Common::MGW::ReqCacheStats>(
+          Filters::Common::MGW::ReqDecisionCache::generateStats(stats_prefix + "mgw.request_cache.",
+                                                               scope_));
+    }
+  }
+
+  absl::optional<Filters::Common::MGW::CallLimiterConfig> limiter_config;
+  Filters::Common::MGW::CallLimiterStatsSharedPtr limiter_stats;
+  if (config.has_call_limits()) {
+    limiter_config = callLimiterConfig(config.call_limits());
+    limiter_stats = std::make_shared<Filters::Common::MGW::CallLimiterStats>(
+        Filters::Common::MGW::CallLimiter::generateStats(stats_prefix + "mgw.limiter.", scope_));
+  }
+
+  absl::optional<Filters::Common::MGW::ResHedgeConfig> hedge_config;
+  Filters::Common::MGW::ResHedgeStatsSharedPtr hedge_stats;
+  if (config.has_hedging()) {
+    const auto& hedging = config.hedging();
+    hedge_config = Filters::Common::MGW::ResHedgeConfig{
+        hedging.has_delay() ? absl::make_optional(std::chrono::milliseconds(
+                                  DurationUtil::durationToMilliseconds(hedging.delay())))
+                            : absl::nullopt,
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(hedging, budget_percent, DefaultHedgeBudgetPercent) /
+            100.0};
+    hedge_stats = std::make_shared<Filters::Common::MGW::ResHedgeStats>(
+        Filters::Common::MGW::ResHedgePolicy::generateStats(stats_prefix + "mgw.hedge.", scope_));
+  }
+
+  if (config.has_deadline_budget()) {
+    deadline_min_remaining_ = std::chrono::milliseconds(PROTOBUF_GET_MS_OR_DEFAULT(
+        config.deadline_budget(), min_remaining, DefaultDeadlineMinRemainingMs));
+  }
+
+  if (config.has_tail_sampling()) {
+    const auto& tail = config.tail_sampling();
+    if (tail.has_latency_threshold()) {
+      tail_latency_threshold_ =
+          std::chrono::milliseconds(DurationUtil::durationToMilliseconds(tail.latency_threshold()));
+    }
+    for (const auto& range : tail.response_codes()) {
+      tail_response_codes_.emplace_back(range.start(), range.end());
+    }
+    if (tail_response_codes_.empty()) {
+      tail_response_codes_.emplace_back(DefaultTailCodesStart, DefaultTailCodesEnd);
+    }
+    if (tail.has_background_rate()) {
+      tail_background_rate_.emplace(tail.background_rate(), runtime_);
+    }
+  }
+
+  absl::optional<Filters::Common::MGW::AdaptiveTimeoutConfig> adaptive_config;
+  Filters::Common::MGW::AdaptiveTimeoutStatsSharedPtr adaptive_stats;
+  if (config.has_adaptive_timeout()) {
+    const auto& adaptive = config.adaptive_timeout();
+    adaptive_config = Filters::Common::MGW::AdaptiveTimeoutConfig{
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(adaptive, percentile, DefaultAdaptivePercentile) / 100.0,
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(adaptive, headroom_percent,
+                                        DefaultAdaptiveHeadroomPercent) /
+            100.0,
+        std::min(timeout_, std::chrono::milliseconds(PROTOBUF_GET_MS_OR_DEFAULT(
+                               adaptive, min_timeout, DefaultAdaptiveMinTimeoutMs))),
+        timeout_,
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(adaptive, window_calls, DefaultAdaptiveWindowCalls)};
+    adaptive_stats = std::make_shared<Filters::Common::MGW::AdaptiveTimeoutStats>(
+        Filters::Common::MGW::AdaptiveTimeout::generateStats(stats_prefix + "mgw.adaptive_timeout.",
+                                                             scope_));
+  }
+
+  absl::optional<uint32_t> single_flight_max_waiters;
+  Filters::Common::MGW::ResSingleFlightStatsSharedPtr single_flight_stats;
+  if (config.has_single_flight()) {
+    single_flight_max_waiters = PROTOBUF_GET_WRAPPED_OR_DEFAULT(config.single_flight(), max_waiters,
+                                                                DefaultSingleFlightMaxWaiters);
+    single_flight_stats = std::make_shared<Filters::Common::MGW::ResSingleFlightStats>(
+        Filters::Common::MGW::ResSingleFlight::generateStats(stats_prefix + "mgw.single_flight.",
+                                                             scope_));
+  }
+
+  absl::optional<Filters::Common::MGW::ResSpoolConfig> spool_config;
+  Filters::Common::MGW::ResSpoolStatsSharedPtr spool_stats;
+  std::string spool_directory;
+  // Only the gRPC publishers hand undeliverable requests to a spool.
+  if (config.has_spool() &&
+      (config.async_publisher_case() ==
+           envoy::extensions::filters::http::mgw::v3::MGW::AsyncPublisherCase::kBatch ||
+       config.async_publisher_case() ==
+           envoy::extensions::filters::http::mgw::v3::MGW::AsyncPublisherCase::kStream)) {
+    const auto& spool = config.spool();
+    spool_config = Filters::Common::MGW::ResSpoolConfig{
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(spool, max_bytes, DefaultSpoolMaxBytes),
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(spool, segment_bytes, DefaultSpoolSegmentBytes),
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(spool, replay_rate, DefaultSpoolReplayRate)};
+    spool_stats = std::make_shared<Filters::Common::MGW::ResSpoolStats>(
+        Filters::Common::MGW::ResSpool::generateStats(stats_prefix + "mgw.spool.", scope_));
+    spool_directory = spool.directory();
+    if (::mkdir(spool_directory.c_str(), 0700) != 0 && errno != EEXIST) {
+      throw EnvoyException(
+          fmt::format("mgw spool directory {} cannot be created: {}", spool_directory,
+                      strerror(errno)));
+    }
+  }
+  absl::optional<std::chrono::milliseconds> warmup_retry_interval;
+  Filters::Common::MGW::ResWarmupStatsSharedPtr warmup_stats;
+  if (config.has_warmup()) {
+    warmup_retry_interval = std::chrono::milliseconds(PROTOBUF_GET_MS_OR_DEFAULT(
+        config.warmup(), retry_interval, DefaultWarmupRetryIntervalMs));
+    warmup_stats = std::make_shared<Filters::Common::MGW::ResWarmupStats>(
+        Filters::Common::MGW::ResWarmup::generateStats(stats_prefix + "mgw.warmup.", scope_));
+  }
+  tls_ = tls.allocateSlot();
+  tls_->set([factory, create_publisher, mode = mode_, req_factory, cache_config, cache_stats,
+             limiter_config, limiter_stats, hedge_config, hedge_stats, adaptive_config,
+             adaptive_stats, single_flight_max_waiters, single_flight_stats, spool_config,
+             spool_stats, spool_directory, warmup_retry_interval, warmup_stats,
+             &main_dispatcher = dispatcher](
+                Event::Dispatcher& dispatcher) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    auto state = std::make_shared<ThreadLocalState>();
+    // The slot is set on the main thread as well, which never runs a filter. A spool there would
+    // take the directory of a worker and never replay it, a publisher would hold a stream or a
+    // shared memory ring for nothing.
+    const bool on_main_thread = &dispatcher == &main_dispatcher;
+    if (spool_config.has_value() && !on_main_thread) {
+      state->spool_ = std::make_unique<Filters::Common::MGW::ResSpool>(
+          spool_config.value(), spool_directory, spool_stats, dispatcher);
+    }
+    if (!on_main_thread && (mode == envoy::extensions::filters::http::mgw::v3::MGW::ASYNC ||
+                            state->spool_ != nullptr)) {
+      // A spool starts replaying what earlier processes left, so its publisher is needed now.
+      state->publisher_ = create_publisher(dispatcher, state->spool_.get());
+      if (state->spool_ != nullptr) {
+        state->spool_->setReplayCallback(
+            [&publisher = *state->publisher_](
+                const envoy::service::mgw_res::v3::CheckRequest& request) -> void {
+              publisher.publish(request);
+            });
+      }
+    } else if (mode == envoy::extensions::filters::http::mgw::v3::MGW::SYNC) {
+      state->async_client_ = factory->create();
+    }
+    if (req_factory != nullptr) {
+      state->req_async_client_ = req_factory->create();
+    }
+    if (cache_config.has_value()) {
+      state->req_cache_ = std::make_unique<Filters::Common::MGW::ReqDecisionCache>(
+          cache_config.value(), cache_stats, dispatcher.timeSource());
+    }
+    if (limiter_config.has_value()) {
+      state->call_limiter_ = std::make_unique<Filters::Common::MGW::CallLimiter>(
+          limiter_config.value(), limiter_stats, dispatcher.timeSource());
+    }
+    if (hedge_config.has_value()) {
+      state->hedge_policy_ = std::make_unique<Filters::Common::MGW::ResHedgePolicy>(
+          hedge_config.value(), hedge_stats, dispatcher);
+    }
+    if (adaptive_config.has_value()) {
+      state->adaptive_timeout_ = std::make_unique<Filters::Common::MGW::AdaptiveTimeout>(
+          adaptive_config.value(), adaptive_stats);
+    }
+    if (single_flight_max_waiters.has_value()) {
+      // The streams whose calls are shared still publish their own requests.
+      if (state->publisher_ == nullptr && !on_main_thread) {
+        state->publisher_ = create_publisher(dispatcher, state->spool_.get());
+      }
+      state->single_flight_ = std::make_unique<Filters::Common::MGW::ResSingleFlight>(
+          single_flight_max_waiters.value(), single_flight_stats, state->publisher_.get(),
+          dispatcher);
+    }
+    // Only workers are warmed up, so the gauges count workers.
+    if (warmup_retry_interval.has_value() && !on_main_thread) {
+      // The sync mode client is made now whatever the mode, routes may still switch to it.
+      if (state->async_client_ == nullptr) {
+        state->async_client_ = factory->create();
+      }
+      state->warmup_ = std::make_unique<Filters::Common::MGW::ResWarmup>(
+          state->async_client_, warmup_retry_interval.value(), warmup_stats, dispatcher);
+    }
+    return state;
+  });
+
+  // Reports go out from the main thread, so the reporter gets a client of its own.
+  rollup_interval_ = std::chrono::milliseconds(
+      PROTOBUF_GET_MS_OR_DEFAULT(config.aggregation(), interval, DefaultAggregationIntervalMs));
+  rollup_reporter_ = std::make_shared<Filters::Common::MGW::GrpcResRollupReporterImpl>(
+      factory->create(), timeout_, scope_, stats_prefix + "mgw.aggregate.");
+  rollup_timer_ = dispatcher.createTimer([this]() -> void {
+    if (rollups_used_.load(std::memory_order_relaxed)) {
+      reportRollups();
+    }
+    rollup_timer_->enableTimer(rollup_interval_);
+  });
+  rollup_timer_->enableTimer(rollup_interval_);
+}
+
+const FilterConfigPerRoute*
+FilterConfig::perRouteConfig(const Router::RouteConstSharedPtr& route) {
+  return Http::Utility::resolveMostSpecificPerFilterConfig<FilterConfigPerRoute>(filterName(),
+                                                                                 route);
+}
+
+bool FilterConfig::sampled(const FilterConfigPerRoute* per_route) const {
+  const absl::optional<Runtime::FractionalPercent>& sampling =
+      per_route != nullptr && per_route->sampling().has_value() ? per_route->sampling()
+                                                                : sampling_;
+  return !sampling.has_value() || sampling->enabled();
+}
+
+bool FilterConfig::tailSampled(uint32_t response_code, std::chrono::milliseconds latency) const {
+  if (tail_latency_threshold_.has_value() && latency >= tail_latency_threshold_.value()) {
+    return true;
+  }
+  const int64_t code = response_code;
+  for (const auto& range : tail_response_codes_) {
+    if (code >= range.first && code < range.second) {
+      return true;
+    }
+  }
+  // Rolled last, so outliers don't use up the runtime lookup.
+  return tail_background_rate_.has_value() && tail_background_rate_->enabled();
+}
+
+const Grpc::RawAsyncClientSharedPtr& FilterConfig::asyncClient() {
+  auto& state = tls_->getTyped<ThreadLocalState>();
+  if (state.async_client_ == nullptr) {
+    state.async_client_ = factory_->create();
+  }
+  return state.async_client_;
+}
+
+Filters::Common::MGW::ResClientPtr
+FilterConfig::createResClient(std::chrono::milliseconds timeout) {
+  Filters::Common::MGW::ResSingleFlight* single_flight =
+      tls_->getTyped<ThreadLocalState>().single_flight_.get();
+  if (single_flight != nullptr) {
+    // The config outlives its filters, and so the calls they wait for.
+    return std::make_unique<Filters::Common::MGW::SingleFlightResClient>(
+        *single_flight, timeout,
+        [this](std::chrono::milliseconds call_timeout) { return createCallClient(call_timeout); });
+  }
+  return createCallClient(timeout);
+}
+
+Filters::Common::MGW::ResClientPtr
+FilterConfig::createCallClient(std::chrono::milliseconds timeout) {
+  Filters::Common::MGW::ResHedgePolicy* hedge_policy = hedgePolicy();
+  if (hedge_policy != nullptr) {
+    return std::make_unique<Filters::Common::MGW::HedgedGrpcResClientImpl>(
+        asyncClient(), timeout, *hedge_policy, callLimiter());
+  }
+  return std::make_unique<Filters::Common::MGW::GrpcResClientImpl>(asyncClient(), timeout);
+}
+
+Filters::Common::MGW::ResPublisher& FilterConfig::publisher(Event::Dispatcher& dispatcher) {
+  auto& state = tls_->getTyped<ThreadLocalState>();
+  if (state.publisher_ == nullptr) {
+    state.publisher_ = create_publisher_(dispatcher, nullptr);
+  }
+  return *state.publisher_;
+}
+
+void FilterConfig::reportRollups() {
+  auto collector = std::make_shared<Filters::Common::MGW::ResRollupCollector>();
+  std::weak_ptr<Filters::Common::MGW::GrpcResRollupReporterImpl> reporter = rollup_reporter_;
+  tls_->runOnAllThreads(
+      [collector](ThreadLocal::ThreadLocalObjectSharedPtr object)
+          -> ThreadLocal::ThreadLocalObjectSharedPtr {
+        // Runs on each worker. Merging empties the worker's rollups for the next interval.
+        collector->merge(std::move(static_cast<ThreadLocalState&>(*object).rollups_));
+        return object;
+      },
+      [collector, reporter, interval = rollup_interval_]() -> void {
+        // Runs on the main thread once every worker has merged.
+        auto locked_reporter = reporter.lock();
+        if (locked_reporter != nullptr) {
+          locked_reporter->report(collector->release(), interval);
+        }
+      });
+}
+
+Filters::Common::MGW::CallLimiterConfig FilterConfig::callLimiterConfig(
+    const envoy::extensions::filters::http::mgw::v3::MGW::CallLimits& limits) {
+  Filters::Common::MGW::CallLimiterConfig limiter_config{};
+  limiter_config.max_limit_ = PROTOBUF_GET_WRAPPED_OR_DEFAULT(
+      limits, max_active_calls, limits.has_adaptive() ? DefaultAdaptiveMaxLimit : 0);
+  if (limits.has_adaptive()) {
+    limiter_config.target_latency_ = std::chrono::milliseconds(
+        DurationUtil::durationToMilliseconds(limits.adaptive().target_latency()));
+    limiter_config.min_limit_ = std::min(
+        limiter_config.max_limit_,
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(limits.adaptive(), min_limit, DefaultAdaptiveMinLimit));
+  } else {
+    limiter_config.min_limit_ = limiter_config.max_limit_;
+  }
+  if (limits.has_circuit_breaker()) {
+    const auto& breaker = limits.circuit_breaker();
+    limiter_config.consecutive_errors_ = PROTOBUF_GET_WRAPPED_OR_DEFAULT(
+        breaker, consecutive_errors, DefaultCircuitConsecutiveErrors);
+    limiter_config.open_interval_ = std::chrono::milliseconds(
+        PROTOBUF_GET_MS_OR_DEFAULT(breaker, open_interval, DefaultCircuitOpenIntervalMs));
+  }
+  return limiter_config;
+}
+
+FilterConfig::ResPublisherFactory
+FilterConfig::publisherFactory(const envoy::extensions::filters::http::mgw::v3::MGW& config,
+                               const std::string& stats_prefix,
+                               const std::shared_ptr<Grpc::AsyncClientFactory>& factory) {
+  const std::chrono::milliseconds timeout = timeout_;
+
+  switch (config.async_publisher_case()) {
+  case envoy::extensions::filters::http::mgw::v3::MGW::AsyncPublisherCase::kBatch: {
+    const auto& batch = config.batch();
+    const Filters::Common::MGW::ResBatcherConfig batcher_config{
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(batch, max_events, DefaultBatchMaxEvents),
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(batch, max_bytes, DefaultBatchMaxBytes),
+        std::chrono::milliseconds(
+            PROTOBUF_GET_MS_OR_DEFAULT(batch, max_linger, DefaultBatchMaxLingerMs)),
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(batch, max_pending_batches, DefaultBatchMaxPendingBatches),
+        batch.encoding()};
+    auto batcher_stats = std::make_shared<Filters::Common::MGW::ResBatcherStats>(
+        Filters::Common::MGW::GrpcResBatcherImpl::generateStats(stats_prefix + "mgw.batch.",
+                                                                scope_));
+    return [factory, timeout, batcher_config,
+            batcher_stats](Event::Dispatcher& dispatcher, Filters::Common::MGW::ResSpool* spool)
+               -> Filters::Common::MGW::ResPublisherPtr {
+      return std::make_unique<Filters::Common::MGW::GrpcResBatcherImpl>(
+          factory->create(), timeout, batcher_config, batcher_stats, dispatcher, spool);
+    };
+  }
+  case envoy::extensions::filters::http::mgw::v3::MGW::AsyncPublisherCase::kStream: {
+    const auto& stream = config.stream();
+    const uint64_t base_reconnect_ms =
+        PROTOBUF_GET_MS_OR_DEFAULT(stream, base_reconnect_interval, DefaultStreamBaseReconnectMs);
+    const Filters::Common::MGW::ResStreamConfig stream_config{
+        std::chrono::milliseconds(base_reconnect_ms),
+        std::chrono::milliseconds(std::max(
+            base_reconnect_ms,
+            PROTOBUF_GET_MS_OR_DEFAULT(stream, max_reconnect_interval, base_reconnect_ms * 10)))};
+    auto stream_stats = std::make_shared<Filters::Common::MGW::ResStreamStats>(
+        Filters::Common::MGW::GrpcResStreamImpl::generateStats(stats_prefix + "mgw.stream.",
+                                                               scope_));
+    return [factory, stream_config, stream_stats,
+            &random = random_](Event::Dispatcher& dispatcher, Filters::Common::MGW::ResSpool* spool)
+               -> Filters::Common::MGW::ResPublisherPtr {
+      return std::make_unique<Filters::Common::MGW::GrpcResStreamImpl>(
+          factory->create(), stream_config, stream_stats, dispatcher, random, spool);
+    };
+  }
+  case envoy::extensions::filters::http::mgw::v3::MGW::AsyncPublisherCase::kSharedMemory: {
+    const auto& shared_memory = config.shared_memory();
+    uint32_t ring_records =
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(shared_memory, ring_records, DefaultShmRingRecords);
+    // Validation caps ring_records at 2^24, so this cannot overflow.
+    uint32_t rounded = 1;
+    while (rounded < ring_records) {
+      rounded <<= 1;
+    }
+    const Filters::Common::MGW::ResShmConfig shm_config{
+        rounded,
+        PROTOBUF_GET_WRAPPED_OR_DEFAULT(shared_memory, record_bytes, DefaultShmRecordBytes)};
+    const uint64_t ring_bytes =
+        static_cast<uint64_t>(shm_config.ring_records_) * shm_config.record_bytes_;
+    if (ring_bytes > Filters::Common::MGW::ResShmMaxRingBytes) {
+      throw EnvoyException(fmt::format(
+          "mgw shared memory ring of {} records of {} bytes exceeds the limit of {} bytes",
+          shm_config.ring_records_, shm_config.record_bytes_,
+          Filters::Common::MGW::ResShmMaxRingBytes));
+    }
+    const std::string directory = shared_memory.directory();
+    if (::mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+      throw EnvoyException(fmt::format("mgw shared memory directory {} cannot be created: {}",
+                                       directory, strerror(errno)));
+    }
+    auto shm_stats = std::make_shared<Filters::Common::MGW::ResShmStats>(
+        Filters::Common::MGW::ShmResPublisherImpl::generateStats(stats_prefix + "mgw.shm.",
+                                                                 scope_));
+    // A worker that cannot get a ring publishes like one without an async publisher.
+    return [shm_config, directory, shm_stats,
+            create_grpc = grpcPublisherFactory(config, stats_prefix, factory)](
+               Event::Dispatcher& dispatcher,
+               Filters::Common::MGW::ResSpool* spool) -> Filters::Common::MGW::ResPublisherPtr {
+      // Only called from the constructor, while the references are still valid.
+      return std::make_unique<Filters::Common::MGW::ShmResPublisherImpl>(
+          shm_config, directory, shm_stats, [&]() -> Filters::Common::MGW::ResPublisherPtr {
+            return create_grpc(dispatcher, spool);
+          });
+    };
+  }
+  case envoy::extensions::filters::http::mgw::v3::MGW::AsyncPublisherCase::ASYNC_PUBLISHER_NOT_SET:
+    break;
+  }
+
+  return grpcPublisherFactory(config, stats_prefix, factory);
+}
+
+FilterConfig::ResPublisherFactory
+FilterConfig::grpcPublisherFactory(const envoy::extensions::filters::http::mgw::v3::MGW& config,
+                                   const std::string& stats_prefix,
+                                   const std::shared_ptr<Grpc::AsyncClientFactory>& factory) {
+  const std::chrono::milliseconds timeout = timeout_;
+  const uint32_t max_pending =
+      PROTOBUF_GET_WRAPPED_OR_DEFAULT(config, max_pending_publishes, DefaultMaxPendingPublishes);
+  auto publisher_stats = std::make_shared<Filters::Common::MGW::ResPublisherStats>(
+      Filters::Common::MGW::GrpcResPublisherImpl::generateStats(stats_prefix + "mgw.", scope_));
+  return [factory, timeout, max_pending, publisher_stats](
+             Event::Dispatcher&,
+             Filters::Common::MGW::ResSpool*) -> Filters::Common::MGW::ResPublisherPtr {
+    return std::make_unique<Filters::Common::MGW::GrpcResPublisherImpl>(
+        factory->create(), timeout, max_pending, publisher_stats);
+  };
+}
+
+} // namespace MGW
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -1,27 +1,48 @@
 #pragma once
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "mgw-api/extensions/filters/http/mgw/v3/mgw.pb.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/grpc/async_client_manager.h"
 #include "envoy/http/filter.h"
 #include "envoy/local_info/local_info.h"
+#include "envoy/router/router.h"
 #include "envoy/runtime/runtime.h"
 #include "envoy/service/auth/v3/external_auth.pb.h"
 #include "envoy/stats/scope.h"
 #include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
 #include "envoy/upstream/cluster_manager.h"
 #include "envoy/http/context.h"
+#include "mgw-api/services/response/v3/mgw_res.pb.h"
 
 #include "common/common/assert.h"
 #include "common/common/logger.h"
+#include "common/common/macros.h"
 #include "common/common/matchers.h"
 #include "common/http/codes.h"
 #include "common/http/header_map_impl.h"
+#include "common/protobuf/utility.h"
 #include "common/runtime/runtime_protos.h"
 
 #include "mgw-source/filters/common/mgw/mgw.h"
+#include "mgw-source/filters/common/mgw/mgw_call_limiter.h"
+#include "mgw-source/filters/common/mgw/mgw_req_cache.h"
+#include "mgw-source/filters/common/mgw/mgw_res_adaptive_timeout.h"
+#include "mgw-source/filters/common/mgw/mgw_res_hedging.h"
+#include "mgw-source/filters/common/mgw/mgw_res_rollup.h"
+#include "mgw-source/filters/common/mgw/mgw_res_single_flight.h"
+#include "mgw-source/filters/common/mgw/mgw_res_spool.h"
+#include "mgw-source/filters/common/mgw/mgw_res_warmup.h"
+#include "mgw-source/filters/http/mgw/response_rules.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -32,17 +53,112 @@ namespace MGW {
  * All stats for the mgw filter. @see stats_macros.h
  */
 
-#define ALL_mgw_FILTER_STATS(COUNTER)                                                        \
+#define ALL_mgw_FILTER_STATS(COUNTER, GAUGE, HISTOGRAM)                                      \
   COUNTER(ok)                                                                                      \
   COUNTER(denied)                                                                                  \
   COUNTER(error)                                                                                   \
-  COUNTER(failure_mode_allowed)
+  COUNTER(failure_mode_allowed)                                                                    \
+  COUNTER(sampled)                                                                                 \
+  COUNTER(unsampled)                                                                               \
+  COUNTER(body_truncated)                                                                          \
+  COUNTER(header_truncated)                                                                        \
+  COUNTER(rule_matched)                                                                            \
+  COUNTER(rule_fallback)                                                                           \
+  COUNTER(tail_kept)                                                                               \
+  COUNTER(tail_dropped)                                                                            \
+  COUNTER(intercept_timeout)                                                                       \
+  COUNTER(deadline_skipped)                                                                        \
+  COUNTER(intercept_cancelled)                                                                     \
+  GAUGE(intercept_active, Accumulate)                                                              \
+  HISTOGRAM(request_intercept_latency, Milliseconds)                                               \
+  HISTOGRAM(response_intercept_latency, Milliseconds)                                              \
+  HISTOGRAM(decode_paused_time, Milliseconds)                                                      \
+  HISTOGRAM(encode_paused_time, Milliseconds)                                                      \
+  HISTOGRAM(intercept_request_size, Bytes)
 
 /**
  * Wrapper struct for mgw filter stats. @see stats_macros.h
  */
 struct MGWFilterStats {
-  ALL_mgw_FILTER_STATS(GENERATE_COUNTER_STRUCT)
+  ALL_mgw_FILTER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT, GENERATE_HISTOGRAM_STRUCT)
+};
+
+using Mode = envoy::extensions::filters::http::mgw::v3::MGW::Mode;
+
+/**
+ * A response header copied into intercept requests, resolved once from the configuration.
+ */
+struct ProjectedHeader {
+  Http::LowerCaseString name_;
+  uint32_t max_value_bytes_;
+};
+
+/**
+ * Per route settings of the mgw filter.
+ */
+class FilterConfigPerRoute : public Router::RouteSpecificFilterConfig {
+public:
+  FilterConfigPerRoute(const envoy::extensions::filters::http::mgw::v3::MGWPerRoute& config,
+                       Runtime::Loader& runtime)
+      : sampling_(config.has_sampling()
+                      ? absl::make_optional<Runtime::FractionalPercent>(config.sampling(), runtime)
+                      : absl::nullopt),
+        disabled_(config.disabled()),
+        mode_(config.has_mode() ? absl::make_optional(config.mode().mode()) : absl::nullopt),
+        timeout_(config.has_timeout()
+                     ? absl::make_optional(std::chrono::milliseconds(
+                           DurationUtil::durationToMilliseconds(config.timeout())))
+                     : absl::nullopt) {}
+
+  const absl::optional<Runtime::FractionalPercent>& sampling() const { return sampling_; }
+
+  bool disabled() const { return disabled_; }
+
+  const absl::optional<Mode>& mode() const { return mode_; }
+
+  const absl::optional<std::chrono::milliseconds>& timeout() const { return timeout_; }
+
+private:
+  const absl::optional<Runtime::FractionalPercent> sampling_;
+  const bool disabled_;
+  const absl::optional<Mode> mode_;
+  const absl::optional<std::chrono::milliseconds> timeout_;
+};
+
+/**
+ * Per worker state shared by every mgw filter instance running on that worker.
+ */
+struct ThreadLocalState : public ThreadLocal::ThreadLocalObject {
+  // Client shared by the sync mode intercept calls of this worker. Created on first use unless
+  // sync is the filter's mode or connections are warmed up.
+  Grpc::RawAsyncClientSharedPtr async_client_;
+  // Opens this worker's connection to the service. Null unless warm up is configured.
+  Filters::Common::MGW::ResWarmupPtr warmup_;
+  // Undeliverable requests of the publisher. Null unless spooling is configured. Declared before
+  // the publisher, which spools what it still holds when it is destroyed.
+  Filters::Common::MGW::ResSpoolPtr spool_;
+  // Sink for intercept requests in async mode. Created on first use unless async is the filter's
+  // mode or requests are spooled.
+  Filters::Common::MGW::ResPublisherPtr publisher_;
+  // Async mode requests are built here and handed to the publisher, which copies or serializes
+  // them. Clearing keeps the strings' capacity, so after warm up building a request does not
+  // allocate.
+  envoy::service::mgw_res::v3::CheckRequest publish_request_;
+  // Responses of this worker since the last report. Only used in aggregate mode.
+  Filters::Common::MGW::ResRollups rollups_;
+  // Client shared by the request intercept calls of this worker. Null unless requests are
+  // intercepted.
+  Grpc::RawAsyncClientSharedPtr req_async_client_;
+  // Request decisions of this worker. Null unless the decision cache is configured.
+  Filters::Common::MGW::ReqDecisionCachePtr req_cache_;
+  // Gate in front of the sync mode intercept calls. Null unless call limits are configured.
+  Filters::Common::MGW::CallLimiterPtr call_limiter_;
+  // Hedging state of the sync mode intercept calls. Null unless hedging is configured.
+  Filters::Common::MGW::ResHedgePolicyPtr hedge_policy_;
+  // Timeout of the sync mode intercept calls. Null unless adaptive timeouts are configured.
+  Filters::Common::MGW::AdaptiveTimeoutPtr adaptive_timeout_;
+  // Sync mode intercept calls in flight. Null unless single flight is configured.
+  Filters::Common::MGW::ResSingleFlightPtr single_flight_;
 };
 
 /**
@@ -50,20 +166,163 @@ struct MGWFilterStats {
  */
 class FilterConfig {
 public:
-  FilterConfig(const envoy::extensions::filters::http::mgw::v3::MGW& ,
+  FilterConfig(const envoy::extensions::filters::http::mgw::v3::MGW& config,
                const LocalInfo::LocalInfo& local_info, Stats::Scope& scope,
                Runtime::Loader& runtime, Http::Context& http_context,
-               const std::string& stats_prefix)
-      : local_info_(local_info),
-        scope_(scope), runtime_(runtime), http_context_(http_context),
-        pool_(scope_.symbolTable()),
-        stats_(generateStats(stats_prefix, scope)), mgw_ok_(pool_.add("mgw.ok")),
-        mgw_denied_(pool_.add("mgw.denied")),
-        mgw_error_(pool_.add("mgw.error")),
-        mgw_failure_mode_allowed_(pool_.add("mgw.failure_mode_allowed")) {}
+               const std::string& stats_prefix, ThreadLocal::SlotAllocator& tls,
+               Grpc::AsyncClientManager& async_client_manager, Runtime::RandomGenerator& random,
+               Event::Dispatcher& dispatcher, std::chrono::milliseconds timeout);
 
   const LocalInfo::LocalInfo& localInfo() const { return local_info_; }
 
+  Mode mode() const { return mode_; }
+
+  const std::chrono::milliseconds& timeout() const { return timeout_; }
+
+  /**
+   * @return the number of response body bytes to capture per stream, 0 if capture is disabled.
+   */
+  uint32_t bodyCaptureBytes() const { return body_capture_bytes_; }
+
+  /**
+   * @return the response headers to copy into intercept requests, in configuration order.
+   */
+  const std::vector<ProjectedHeader>& projectedHeaders() const { return projected_headers_; }
+
+  /**
+   * @return the rules that decide sync mode responses without calling the service.
+   */
+  const ResponseRules& responseRules() const { return response_rules_; }
+
+  /**
+   * @return the settings of the route or nullptr if it has none.
+   */
+  static const FilterConfigPerRoute* perRouteConfig(const Router::RouteConstSharedPtr& route);
+
+  /**
+   * Rolls the sampling dice for a response, honouring the route's override.
+   * @param per_route supplies the route's settings, may be nullptr.
+   * @return true if the response on this route should be intercepted.
+   */
+  bool sampled(const FilterConfigPerRoute* per_route) const;
+
+  /**
+   * @return true if async mode responses are only published if tailSampled() says so.
+   */
+  bool tailSampling() const { return tail_sampling_; }
+
+  /**
+   * Decides, once an async mode response is complete, whether it is published.
+   * @param response_code supplies the status of the response.
+   * @param latency supplies the time from the start of the request to the end of the response.
+   * @return true if the response was slow, failed or won the background roll.
+   */
+  bool tailSampled(uint32_t response_code, std::chrono::milliseconds latency) const;
+
+  /**
+   * @return the name the filter is registered under, which is also the key of its per route
+   * config.
+   */
+  static const std::string& filterName() {
+    CONSTRUCT_ON_FIRST_USE(std::string, "envoy.filters.http.mgw");
+  }
+
+  /**
+   * @return the async client of the calling worker for sync mode calls.
+   */
+  const Grpc::RawAsyncClientSharedPtr& asyncClient();
+
+  /**
+   * @return a client for one sync mode intercept call, hedged if hedging is configured and
+   * sharing identical calls if single flight is.
+   */
+  Filters::Common::MGW::ResClientPtr createResClient(std::chrono::milliseconds timeout);
+
+  /**
+   * @return the call limiter of the calling worker or nullptr if calls are not limited.
+   */
+  Filters::Common::MGW::CallLimiter* callLimiter() {
+    return tls_->getTyped<ThreadLocalState>().call_limiter_.get();
+  }
+
+  /**
+   * @return the hedging policy of the calling worker or nullptr if calls are not hedged.
+   */
+  Filters::Common::MGW::ResHedgePolicy* hedgePolicy() {
+    return tls_->getTyped<ThreadLocalState>().hedge_policy_.get();
+  }
+
+  /**
+   * @return the adaptive timeout of the calling worker or nullptr if timeouts are fixed.
+   */
+  Filters::Common::MGW::AdaptiveTimeout* adaptiveTimeout() {
+    return tls_->getTyped<ThreadLocalState>().adaptive_timeout_.get();
+  }
+
+  /**
+   * @return the least route timeout that must be left for a sync mode call to be made, unset if
+   * calls are not bounded by the route timeout.
+   */
+  const absl::optional<std::chrono::milliseconds>& deadlineMinRemaining() const {
+    return deadline_min_remaining_;
+  }
+
+  /**
+   * @return the publisher of the calling worker.
+   */
+  Filters::Common::MGW::ResPublisher& publisher(Event::Dispatcher& dispatcher);
+
+  /**
+   * @return the cleared request the calling worker builds its async mode requests in. Only valid
+   * until it is published.
+   */
+  envoy::service::mgw_res::v3::CheckRequest& publishRequest() {
+    auto& request = tls_->getTyped<ThreadLocalState>().publish_request_;
+    request.Clear();
+    return request;
+  }
+
+  /**
+   * @return the rollups of the calling worker. Only used in aggregate mode.
+   */
+  Filters::Common::MGW::ResRollups& rollups() {
+    // Read first, so that workers only share the cache line once it is set.
+    if (!rollups_used_.load(std::memory_order_relaxed)) {
+      rollups_used_.store(true, std::memory_order_relaxed);
+    }
+    return tls_->getTyped<ThreadLocalState>().rollups_;
+  }
+
+  /**
+   * @return true if requests are sent to the request interception service before they are
+   * forwarded.
+   */
+  bool interceptsRequests() const { return intercepts_requests_; }
+
+  const std::chrono::milliseconds& requestTimeout() const { return request_timeout_; }
+
+  bool failureModeAllow() const { return failure_mode_allow_; }
+
+  /**
+   * @return the request headers whose values form the decision cache key.
+   */
+  const std::vector<Http::LowerCaseString>& cacheKeyHeaders() const { return cache_key_headers_; }
+
+  /**
+   * @return the request intercept client of the calling worker. Only valid if
+   * interceptsRequests().
+   */
+  const Grpc::RawAsyncClientSharedPtr& reqAsyncClient() {
+    return tls_->getTyped<ThreadLocalState>().req_async_client_;
+  }
+
+  /**
+   * @return the decision cache of the calling worker or nullptr if caching is disabled.
+   */
+  Filters::Common::MGW::ReqDecisionCache* reqCache() {
+    return tls_->getTyped<ThreadLocalState>().req_cache_.get();
+  }
+
   Runtime::Loader& runtime() { return runtime_; }
 
   Stats::Scope& scope() { return scope_; }
@@ -72,19 +331,55 @@ public:
 
   const MGWFilterStats& stats() const { return stats_; }
 
+  /**
+   * Increments a legacy cluster scope counter, if the stream was routed to a cluster.
+   */
+  void incClusterCounter(const Upstream::ClusterInfoConstSharedPtr& cluster, Stats::StatName name) {
+    if (cluster != nullptr) {
+      incCounter(cluster->statsScope(), name);
+    }
+  }
+
   void incCounter(Stats::Scope& scope, Stats::StatName name) {
     scope.counterFromStatName(name).inc();
   }
 
 private:
+  using ResPublisherFactory = std::function<Filters::Common::MGW::ResPublisherPtr(
+      Event::Dispatcher&, Filters::Common::MGW::ResSpool*)>;
+
+  // Builds the callback that creates the async publisher of a worker.
+  ResPublisherFactory
+  publisherFactory(const envoy::extensions::filters::http::mgw::v3::MGW& config,
+                   const std::string& stats_prefix,
+                   const std::shared_ptr<Grpc::AsyncClientFactory>& factory);
+
+  // Builds the callback that creates the per request gRPC publisher, used when no
+  // async_publisher is configured.
+  ResPublisherFactory
+  grpcPublisherFactory(const envoy::extensions::filters::http::mgw::v3::MGW& config,
+                       const std::string& stats_prefix,
+                       const std::shared_ptr<Grpc::AsyncClientFactory>& factory);
+
+  // @return a client that makes the call itself, hedged if hedging is configured.
+  Filters::Common::MGW::ResClientPtr createCallClient(std::chrono::milliseconds timeout);
+
+  static Filters::Common::MGW::CallLimiterConfig
+  callLimiterConfig(const envoy::extensions::filters::http::mgw::v3::MGW::CallLimits& limits);
+
+  // Aggregate mode: merges the rollups of all workers and reports them.
+  void reportRollups();
 
   MGWFilterStats generateStats(const std::string& prefix, Stats::Scope& scope) {
     const std::string final_prefix = prefix + "mgw.";
-    return {ALL_mgw_FILTER_STATS(POOL_COUNTER_PREFIX(scope, final_prefix))};
+    return {ALL_mgw_FILTER_STATS(POOL_COUNTER_PREFIX(scope, final_prefix),
+                                 POOL_GAUGE_PREFIX(scope, final_prefix),
+                                 POOL_HISTOGRAM_PREFIX(scope, final_prefix))};
   }
   const LocalInfo::LocalInfo& local_info_;
   Stats::Scope& scope_;
   Runtime::Loader& runtime_;
+  Runtime::RandomGenerator& random_;
   Http::Context& http_context_;
 
   // TODO(nezdolik): stop using pool as part of deprecating cluster scope stats.
@@ -100,6 +395,38 @@ public:
   const Stats::StatName mgw_denied_;
   const Stats::StatName mgw_error_;
   const Stats::StatName mgw_failure_mode_allowed_;
+
+private:
+  const Mode mode_;
+  const std::chrono::milliseconds timeout_;
+  // Unset means every response is intercepted.
+  const absl::optional<Runtime::FractionalPercent> sampling_;
+  // Per worker client or publisher, see ThreadLocalState.
+  ThreadLocal::SlotPtr tls_;
+  // Creates the per worker clients and publishers that are made on first use.
+  std::shared_ptr<Grpc::AsyncClientFactory> factory_;
+  ResPublisherFactory create_publisher_;
+  // The reporter is shared so that a report still being collected from the workers can tell
+  // whether the config is gone. Reports only go out once a stream was aggregated, which may be
+  // due to a route override.
+  std::chrono::milliseconds rollup_interval_{};
+  std::atomic<bool> rollups_used_{};
+  Filters::Common::MGW::GrpcResRollupReporterImplSharedPtr rollup_reporter_;
+  Event::TimerPtr rollup_timer_;
+  // Request interception.
+  const bool intercepts_requests_;
+  std::chrono::milliseconds request_timeout_{};
+  bool failure_mode_allow_{};
+  std::vector<Http::LowerCaseString> cache_key_headers_;
+  const uint32_t body_capture_bytes_;
+  std::vector<ProjectedHeader> projected_headers_;
+  const ResponseRules response_rules_;
+  absl::optional<std::chrono::milliseconds> deadline_min_remaining_;
+  const bool tail_sampling_;
+  absl::optional<std::chrono::milliseconds> tail_latency_threshold_;
+  // [start, end) ranges.
+  std::vector<std::pair<int64_t, int64_t>> tail_response_codes_;
+  absl::optional<Runtime::FractionalPercent> tail_background_rate_;
 };
 
 } // namespace MGW
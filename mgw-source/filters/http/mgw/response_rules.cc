@@ -0,0 +1,70 @@
+#include "mgw-source/filters/http/mgw/response_rules.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace MGW {
+
+ResponseRules::ResponseRules(const RuleProtos& rules) {
+  using RuleProto = envoy::extensions::filters::http::mgw::v3::MGW::ResponseRule;
+  rules_.reserve(rules.size());
+  for (const RuleProto& proto : rules) {
+    Rule& rule = rules_.emplace_back();
+    for (const auto& range : proto.response_codes()) {
+      rule.response_codes_.emplace_back(range.start(), range.end());
+    }
+    if (proto.has_route_name()) {
+      rule.route_name_ = std::make_unique<Matchers::StringMatcherImpl>(proto.route_name());
+    }
+    for (const auto& header : proto.headers()) {
+      rule.headers_.push_back(
+          {Http::LowerCaseString(header.name()),
+           std::make_unique<Matchers::StringMatcherImpl>(header.value())});
+    }
+    rule.outcome_ = proto.outcome() == RuleProto::DENY ? Filters::Common::MGW::CheckStatus::Denied
+                                                       : Filters::Common::MGW::CheckStatus::OK;
+  }
+}
+
+absl::optional<Filters::Common::MGW::CheckStatus>
+ResponseRules::evaluate(uint32_t response_code, absl::string_view route_name,
+                        const Http::ResponseHeaderMap& headers) const {
+  for (const Rule& rule : rules_) {
+    if (rule.matches(response_code, route_name, headers)) {
+      return rule.outcome_;
+    }
+  }
+  return absl::nullopt;
+}
+
+bool ResponseRules::Rule::matches(uint32_t response_code, absl::string_view route_name,
+                                  const Http::ResponseHeaderMap& headers) const {
+  if (!response_codes_.empty()) {
+    const int64_t code = response_code;
+    bool in_range = false;
+    for (const auto& range : response_codes_) {
+      if (code >= range.first && code < range.second) {
+        in_range = true;
+        break;
+      }
+    }
+    if (!in_range) {
+      return false;
+    }
+  }
+  if (route_name_ != nullptr && !route_name_->match(route_name)) {
+    return false;
+  }
+  for (const HeaderCondition& condition : headers_) {
+    const Http::HeaderEntry* header = headers.get(condition.name_);
+    if (header == nullptr || !condition.value_->match(header->value().getStringView())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace MGW
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "mgw-api/extensions/filters/http/mgw/v3/mgw.pb.h"
+#include "envoy/http/header_map.h"
+
+#include "common/common/matchers.h"
+#include "common/protobuf/protobuf.h"
+
+#include "mgw-source/filters/common/mgw/mgw.h"
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace MGW {
+
+/**
+ * The response rules of the filter, compiled once when the config is loaded. Matching a response
+ * only compares integers and runs the precompiled string matchers, it never allocates.
+ */
+class ResponseRules {
+public:
+  using RuleProtos = Protobuf::RepeatedPtrField<
+      envoy::extensions::filters::http::mgw::v3::MGW::ResponseRule>;
+
+  explicit ResponseRules(const RuleProtos& rules);
+
+  bool empty() const { return rules_.empty(); }
+
+  /**
+   * @return the outcome of the first rule that matches the response, or nullopt if none does.
+   */
+  absl::optional<Filters::Common::MGW::CheckStatus>
+  evaluate(uint32_t response_code, absl::string_view route_name,
+           const Http::ResponseHeaderMap& headers) const;
+
+private:
+  struct HeaderCondition {
+    Http::LowerCaseString name_;
+    Matchers::StringMatcherPtr value_;
+  };
+
+  struct Rule {
+    bool matches(uint32_t response_code, absl::string_view route_name,
+                 const Http::ResponseHeaderMap& headers) const;
+
+    // [start, end) ranges.
+    std::vector<std::pair<int64_t, int64_t>> response_codes_;
+    // Null if any route matches.
+    Matchers::StringMatcherPtr route_name_;
+    std::vector<HeaderCondition> headers_;
+    Filters::Common::MGW::CheckStatus outcome_{};
+  };
+
+  std::vector<Rule> rules_;
+};
+
+} // namespace MGW
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
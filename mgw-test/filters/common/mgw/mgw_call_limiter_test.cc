@@ -0,0 +1,177 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "envoy/common/time.h"
+
+#include "common/stats/isolated_store_impl.h"
+
+#include "mgw-source/filters/common/mgw/mgw_call_limiter.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+namespace {
+
+using Admission = CallLimiter::Admission;
+
+// Time only moves when a test says so.
+class ManualTimeSource : public TimeSource {
+public:
+  SystemTime systemTime() override { return {}; }
+  MonotonicTime monotonicTime() override { return now_; }
+
+  MonotonicTime now_;
+};
+
+class CallLimiterTest : public testing::Test {
+public:
+  void initialize(const CallLimiterConfig& config) {
+    stats_ = std::make_shared<CallLimiterStats>(CallLimiter::generateStats("limiter.", store_));
+    limiter_ = std::make_unique<CallLimiter>(config, stats_, time_source_);
+  }
+
+  // Admits calls until the limiter refuses one, then cancels them all.
+  // @return how many calls were admitted.
+  uint32_t admissible() {
+    std::vector<Admission> admitted;
+    for (Admission admission = limiter_->tryAdmit(); admission != Admission::Rejected;
+         admission = limiter_->tryAdmit()) {
+      admitted.push_back(admission);
+    }
+    for (Admission admission : admitted) {
+      limiter_->onCallCancelled(admission);
+    }
+    return admitted.size();
+  }
+
+  void advance(std::chrono::milliseconds duration) { time_source_.now_ += duration; }
+
+  Stats::IsolatedStoreImpl store_;
+  ManualTimeSource time_source_;
+  CallLimiterStatsSharedPtr stats_;
+  std::unique_ptr<CallLimiter> limiter_;
+};
+
+CallLimiterConfig adaptiveConfig() {
+  return {100, std::chrono::milliseconds(10), 1, 0, std::chrono::milliseconds(0)};
+}
+
+CallLimiterConfig breakerConfig() {
+  return {0, absl::nullopt, 0, 2, std::chrono::milliseconds(1000)};
+}
+
+// A burst of slow calls that were all in flight together backs the limit off once.
+TEST_F(CallLimiterTest, SlowBurstBacksOffOnce) {
+  initialize(adaptiveConfig());
+  advance(std::chrono::milliseconds(1000));
+  std::vector<Admission> burst;
+  for (int i = 0; i < 20; ++i) {
+    burst.push_back(limiter_->tryAdmit());
+    ASSERT_EQ(Admission::Admitted, burst.back());
+  }
+  advance(std::chrono::milliseconds(50));
+  for (Admission admission : burst) {
+    limiter_->onCallComplete(admission, std::chrono::milliseconds(50), false);
+  }
+  EXPECT_EQ(90U, admissible());
+  EXPECT_EQ(90U, stats_->concurrency_limit_.value());
+
+  // A slow call started after the decrease backs off again.
+  const Admission admission = limiter_->tryAdmit();
+  advance(std::chrono::milliseconds(50));
+  limiter_->onCallComplete(admission, std::chrono::milliseconds(50), false);
+  EXPECT_EQ(81U, admissible());
+}
+
+// Calls within the target latency raise the limit again, by about one per limit's worth of calls.
+TEST_F(CallLimiterTest, FastCallsRaiseLimit) {
+  initialize(adaptiveConfig());
+  advance(std::chrono::milliseconds(1000));
+  Admission admission = limiter_->tryAdmit();
+  advance(std::chrono::milliseconds(50));
+  limiter_->onCallComplete(admission, std::chrono::milliseconds(50), false);
+  EXPECT_EQ(90U, admissible());
+
+  for (int i = 0; i < 91; ++i) {
+    admission = limiter_->tryAdmit();
+    limiter_->onCallComplete(admission, std::chrono::milliseconds(1), false);
+  }
+  EXPECT_EQ(91U, admissible());
+}
+
+TEST_F(CallLimiterTest, ConsecutiveErrorsOpenBreaker) {
+  initialize(breakerConfig());
+  for (int i = 0; i < 2; ++i) {
+    const Admission admission = limiter_->tryAdmit();
+    ASSERT_EQ(Admission::Admitted, admission);
+    limiter_->onCallComplete(admission, std::chrono::milliseconds(1), true);
+  }
+  EXPECT_EQ(Admission::Rejected, limiter_->tryAdmit());
+  EXPECT_EQ(1U, stats_->circuit_opened_.value());
+  EXPECT_EQ(1U, stats_->circuit_open_.value());
+}
+
+// A success of a call made before the breaker opened leaves it open. Only the trial closes it.
+TEST_F(CallLimiterTest, StaleSuccessKeepsBreakerOpen) {
+  initialize(breakerConfig());
+  const Admission stale = limiter_->tryAdmit();
+  for (int i = 0; i < 2; ++i) {
+    const Admission admission = limiter_->tryAdmit();
+    limiter_->onCallComplete(admission, std::chrono::milliseconds(1), true);
+  }
+  limiter_->onCallComplete(stale, std::chrono::milliseconds(1), false);
+  EXPECT_EQ(Admission::Rejected, limiter_->tryAdmit());
+  EXPECT_EQ(1U, stats_->circuit_open_.value());
+
+  advance(std::chrono::milliseconds(1000));
+  const Admission trial = limiter_->tryAdmit();
+  ASSERT_EQ(Admission::Trial, trial);
+  // Only one trial at a time.
+  EXPECT_EQ(Admission::Rejected, limiter_->tryAdmit());
+  limiter_->onCallComplete(trial, std::chrono::milliseconds(1), false);
+  EXPECT_EQ(0U, stats_->circuit_open_.value());
+  EXPECT_EQ(Admission::Admitted, limiter_->tryAdmit());
+}
+
+// A failed trial keeps the breaker open for another interval.
+TEST_F(CallLimiterTest, FailedTrialReopens) {
+  initialize(breakerConfig());
+  for (int i = 0; i < 2; ++i) {
+    const Admission admission = limiter_->tryAdmit();
+    limiter_->onCallComplete(admission, std::chrono::milliseconds(1), true);
+  }
+  advance(std::chrono::milliseconds(1000));
+  const Admission trial = limiter_->tryAdmit();
+  ASSERT_EQ(Admission::Trial, trial);
+  limiter_->onCallComplete(trial, std::chrono::milliseconds(1), true);
+  EXPECT_EQ(Admission::Rejected, limiter_->tryAdmit());
+  advance(std::chrono::milliseconds(999));
+  EXPECT_EQ(Admission::Rejected, limiter_->tryAdmit());
+  advance(std::chrono::milliseconds(1));
+  EXPECT_EQ(Admission::Trial, limiter_->tryAdmit());
+}
+
+// A cancelled trial says nothing about the service, the next call becomes the trial.
+TEST_F(CallLimiterTest, CancelledTrialAllowsNextTrial) {
+  initialize(breakerConfig());
+  for (int i = 0; i < 2; ++i) {
+    const Admission admission = limiter_->tryAdmit();
+    limiter_->onCallComplete(admission, std::chrono::milliseconds(1), true);
+  }
+  advance(std::chrono::milliseconds(1000));
+  limiter_->onCallCancelled(limiter_->tryAdmit());
+  EXPECT_EQ(Admission::Trial, limiter_->tryAdmit());
+}
+
+} // namespace
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
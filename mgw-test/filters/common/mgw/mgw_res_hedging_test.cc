@@ -0,0 +1,316 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "common/buffer/buffer_impl.h"
+#include "common/stats/isolated_store_impl.h"
+
+#include "mgw-source/filters/common/mgw/mgw_res_hedging.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/grpc/mocks.h"
+#include "test/mocks/stream_info/mocks.h"
+#include "test/mocks/tracing/mocks.h"
+#include "test/test_common/simulated_time_system.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+namespace {
+
+using Admission = CallLimiter::Admission;
+
+constexpr std::chrono::milliseconds Timeout(100);
+constexpr std::chrono::milliseconds HedgeDelay(10);
+
+class MockResponseCallbacks : public ResponseCallbacks {
+public:
+  void onResponseComplete(ResponsePtr&& response) override {
+    onResponseComplete_(response->status);
+  }
+
+  MOCK_METHOD(void, onResponseComplete_, (CheckStatus status));
+};
+
+// One call made upstream: where its answer goes and the handle it can be cancelled through.
+struct Call {
+  Grpc::RawAsyncRequestCallbacks* callbacks_;
+  absl::optional<std::chrono::milliseconds> timeout_;
+  NiceMock<Grpc::MockAsyncRequest> request_;
+};
+
+class ResHedgingTest : public testing::Test {
+public:
+  ResHedgingTest()
+      : async_client_(std::make_shared<NiceMock<Grpc::MockAsyncClient>>()),
+        stats_(std::make_shared<ResHedgeStats>(ResHedgePolicy::generateStats("hedge.", store_))) {
+    ON_CALL(*async_client_, sendRaw(_, _, _, _, _, _))
+        .WillByDefault(Invoke([this](absl::string_view, absl::string_view, Buffer::InstancePtr&&,
+                                     Grpc::RawAsyncRequestCallbacks& callbacks, Tracing::Span&,
+                                     const Http::AsyncClient::RequestOptions& options)
+                                  -> Grpc::AsyncRequest* {
+          calls_.push_back(std::make_unique<Call>());
+          calls_.back()->callbacks_ = &callbacks;
+          calls_.back()->timeout_ = options.timeout;
+          return &calls_.back()->request_;
+        }));
+  }
+
+  void initialize(double budget,
+                  const absl::optional<std::chrono::milliseconds>& delay = HedgeDelay) {
+    policy_ = std::make_unique<ResHedgePolicy>(ResHedgeConfig{delay, budget}, stats_, dispatcher_);
+  }
+
+  void initializeLimiter(uint32_t max_limit) {
+    limiter_stats_ =
+        std::make_shared<CallLimiterStats>(CallLimiter::generateStats("limiter.", store_));
+    limiter_ = std::make_unique<CallLimiter>(
+        CallLimiterConfig{max_limit, absl::nullopt, 0, 0, std::chrono::milliseconds(0)},
+        limiter_stats_, time_system_);
+  }
+
+  // Makes one call through a new client, which hedges through the timer returned.
+  Event::MockTimer* intercept() {
+    auto* hedge_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+    client_ = std::make_unique<HedgedGrpcResClientImpl>(async_client_, Timeout, *policy_,
+                                                        limiter_.get());
+    client_->intercept(callbacks_, request_, span_, stream_info_);
+    return hedge_timer;
+  }
+
+  // Answers call `index` with a CheckResponse of the given gRPC status.
+  void respond(uint32_t index,
+               Grpc::Status::GrpcStatus status = Grpc::Status::WellKnownGrpcStatus::Ok) {
+    envoy::service::mgw_res::v3::CheckResponse response;
+    response.mutable_status()->set_code(status);
+    calls_[index]->callbacks_->onSuccessRaw(
+        std::make_unique<Buffer::OwnedImpl>(response.SerializeAsString()), span_);
+  }
+
+  void fail(uint32_t index) {
+    calls_[index]->callbacks_->onFailure(Grpc::Status::WellKnownGrpcStatus::Unavailable, "",
+                                         span_);
+  }
+
+  // Admits calls until the limiter refuses one, then cancels them all.
+  // @return how many calls were admitted.
+  uint32_t admissible() {
+    std::vector<Admission> admitted;
+    for (Admission admission = limiter_->tryAdmit(); admission != Admission::Rejected;
+         admission = limiter_->tryAdmit()) {
+      admitted.push_back(admission);
+    }
+    for (Admission admission : admitted) {
+      limiter_->onCallCancelled(admission);
+    }
+    return admitted.size();
+  }
+
+  Event::SimulatedTimeSystem time_system_;
+  Stats::IsolatedStoreImpl store_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  std::shared_ptr<NiceMock<Grpc::MockAsyncClient>> async_client_;
+  ResHedgeStatsSharedPtr stats_;
+  std::unique_ptr<ResHedgePolicy> policy_;
+  CallLimiterStatsSharedPtr limiter_stats_;
+  std::unique_ptr<CallLimiter> limiter_;
+  envoy::service::mgw_res::v3::CheckRequest request_;
+  NiceMock<Tracing::MockSpan> span_;
+  NiceMock<StreamInfo::MockStreamInfo> stream_info_;
+  MockResponseCallbacks callbacks_;
+  std::unique_ptr<HedgedGrpcResClientImpl> client_;
+  std::vector<std::unique_ptr<Call>> calls_;
+};
+
+// No hedge is sent for a call answered within the delay.
+TEST_F(ResHedgingTest, AnsweredBeforeDelay) {
+  initialize(1.0);
+  Event::MockTimer* hedge_timer = intercept();
+  ASSERT_EQ(1U, calls_.size());
+  EXPECT_TRUE(hedge_timer->enabled());
+
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(0);
+  EXPECT_FALSE(hedge_timer->enabled());
+  EXPECT_EQ(0U, stats_->hedges_sent_.value());
+}
+
+// Once the timer fires the call is made again, and the first answer cancels the other call.
+TEST_F(ResHedgingTest, HedgeTimerFires) {
+  initialize(1.0);
+  Event::MockTimer* hedge_timer = intercept();
+  time_system_.sleep(HedgeDelay);
+  hedge_timer->invokeCallback();
+  ASSERT_EQ(2U, calls_.size());
+  EXPECT_EQ(1U, stats_->hedges_sent_.value());
+
+  EXPECT_CALL(calls_[1]->request_, cancel());
+  EXPECT_CALL(calls_[0]->request_, cancel()).Times(0);
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(0);
+  EXPECT_EQ(0U, stats_->hedges_won_.value());
+}
+
+TEST_F(ResHedgingTest, HedgeWinsAndPrimaryCancelled) {
+  initialize(1.0);
+  Event::MockTimer* hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+
+  EXPECT_CALL(calls_[0]->request_, cancel());
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::Denied));
+  respond(1, Grpc::Status::WellKnownGrpcStatus::PermissionDenied);
+  EXPECT_EQ(1U, stats_->hedges_won_.value());
+}
+
+// A failed primary waits for the hedge, which may still get through.
+TEST_F(ResHedgingTest, PrimaryErrorWaitsForHedge) {
+  initialize(1.0);
+  Event::MockTimer* hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+
+  EXPECT_CALL(callbacks_, onResponseComplete_(_)).Times(0);
+  fail(0);
+  testing::Mock::VerifyAndClearExpectations(&callbacks_);
+
+  EXPECT_CALL(calls_[0]->request_, cancel()).Times(0);
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(1);
+  EXPECT_EQ(1U, stats_->hedges_won_.value());
+}
+
+// The error is delivered once neither call can succeed.
+TEST_F(ResHedgingTest, BothFail) {
+  initialize(1.0);
+  Event::MockTimer* hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+
+  fail(1);
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::Error));
+  fail(0);
+}
+
+// The hedge gets what is left of the timeout, so the call ends within it whichever attempt
+// answers.
+TEST_F(ResHedgingTest, HedgeGetsRemainingTimeout) {
+  initialize(1.0);
+  Event::MockTimer* hedge_timer = intercept();
+  time_system_.sleep(HedgeDelay);
+  hedge_timer->invokeCallback();
+  ASSERT_EQ(2U, calls_.size());
+  EXPECT_EQ(Timeout, calls_[0]->timeout_);
+  EXPECT_EQ(Timeout - HedgeDelay, calls_[1]->timeout_);
+
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(1);
+}
+
+// A timer that fires late, with no time left, sends no hedge.
+TEST_F(ResHedgingTest, NoHedgeWithoutTimeLeft) {
+  initialize(1.0);
+  Event::MockTimer* hedge_timer = intercept();
+  time_system_.sleep(Timeout);
+  hedge_timer->invokeCallback();
+  EXPECT_EQ(1U, calls_.size());
+  EXPECT_EQ(0U, stats_->hedges_sent_.value());
+
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::Error));
+  fail(0);
+}
+
+// Each call earns half a hedge, so the first one may not hedge and the second may.
+TEST_F(ResHedgingTest, BudgetExhausted) {
+  initialize(0.5);
+  Event::MockTimer* hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+  EXPECT_EQ(1U, calls_.size());
+  EXPECT_EQ(1U, stats_->budget_exhausted_.value());
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK)).Times(2);
+  respond(0);
+
+  hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+  EXPECT_EQ(3U, calls_.size());
+  EXPECT_EQ(1U, stats_->hedges_sent_.value());
+  respond(2);
+}
+
+// The delay follows the latency the caller saw, from the start of the primary, even when the
+// hedge won.
+TEST_F(ResHedgingTest, LatencyFromPrimaryStart) {
+  initialize(1.0, absl::nullopt);
+  policy_->recordLatency(std::chrono::milliseconds(40));
+  Event::MockTimer* hedge_timer = intercept();
+  time_system_.sleep(std::chrono::milliseconds(40));
+  hedge_timer->invokeCallback();
+  time_system_.sleep(std::chrono::milliseconds(5));
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(1);
+
+  // 45ms is above the estimate, which moves up.
+  EXPECT_EQ(std::chrono::milliseconds(43), policy_->hedgeDelay());
+}
+
+// The hedge takes a place in the limiter and gives it back when it loses.
+TEST_F(ResHedgingTest, LimiterAdmitsAndReleasesHedge) {
+  initialize(1.0);
+  initializeLimiter(2);
+  // The caller admits the primary.
+  const Admission primary = limiter_->tryAdmit();
+  Event::MockTimer* hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+  ASSERT_EQ(2U, calls_.size());
+  EXPECT_EQ(0U, admissible());
+
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(0);
+  limiter_->onCallComplete(primary, std::chrono::milliseconds(0), false);
+  EXPECT_EQ(2U, admissible());
+}
+
+TEST_F(ResHedgingTest, LimiterReleasesWinningHedge) {
+  initialize(1.0);
+  initializeLimiter(2);
+  const Admission primary = limiter_->tryAdmit();
+  Event::MockTimer* hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(1);
+  EXPECT_EQ(1U, admissible());
+  limiter_->onCallComplete(primary, std::chrono::milliseconds(0), false);
+  EXPECT_EQ(2U, admissible());
+}
+
+// A hedge the limiter rejects is not sent.
+TEST_F(ResHedgingTest, LimiterRejectsHedge) {
+  initialize(1.0);
+  initializeLimiter(1);
+  const Admission primary = limiter_->tryAdmit();
+  Event::MockTimer* hedge_timer = intercept();
+  hedge_timer->invokeCallback();
+  EXPECT_EQ(1U, calls_.size());
+  EXPECT_EQ(1U, limiter_stats_->over_limit_.value());
+  EXPECT_EQ(0U, stats_->budget_exhausted_.value());
+
+  EXPECT_CALL(callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond(0);
+  limiter_->onCallComplete(primary, std::chrono::milliseconds(0), false);
+  EXPECT_EQ(1U, admissible());
+}
+
+} // namespace
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,229 @@
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/stats/isolated_store_impl.h"
+
+#include "mgw-source/filters/common/mgw/mgw_res_single_flight.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/stream_info/mocks.h"
+#include "test/mocks/tracing/mocks.h"
+#include "test/test_common/simulated_time_system.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::ElementsAre;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+namespace {
+
+constexpr std::chrono::milliseconds Timeout(100);
+
+class MockResClient : public ResClient {
+public:
+  MOCK_METHOD(void, cancel, ());
+  MOCK_METHOD(void, intercept,
+              (ResponseCallbacks & callbacks,
+               const envoy::service::mgw_res::v3::CheckRequest& request,
+               Tracing::Span& parent_span, const StreamInfo::StreamInfo& stream_info));
+};
+
+class MockResPublisher : public ResPublisher {
+public:
+  MOCK_METHOD(void, publish, (const envoy::service::mgw_res::v3::CheckRequest& request));
+};
+
+class MockResponseCallbacks : public ResponseCallbacks {
+public:
+  void onResponseComplete(ResponsePtr&& response) override {
+    onResponseComplete_(response->status);
+  }
+
+  MOCK_METHOD(void, onResponseComplete_, (CheckStatus status));
+};
+
+// One downstream stream: its request, what it knows about the request and its client.
+struct Stream {
+  Stream(const std::string& method) : request_headers_{{":method", method}} {
+    ON_CALL(stream_info_, getRequestHeaders()).WillByDefault(Return(&request_headers_));
+  }
+
+  envoy::service::mgw_res::v3::CheckRequest request_;
+  Http::TestRequestHeaderMapImpl request_headers_;
+  NiceMock<StreamInfo::MockStreamInfo> stream_info_;
+  NiceMock<Tracing::MockSpan> span_;
+  MockResponseCallbacks callbacks_;
+  std::unique_ptr<SingleFlightResClient> client_;
+};
+
+class ResSingleFlightTest : public testing::Test {
+public:
+  ResSingleFlightTest()
+      : stats_(std::make_shared<ResSingleFlightStats>(
+            ResSingleFlight::generateStats("single_flight.", store_))),
+        table_(100, stats_, &publisher_, dispatcher_) {
+    ON_CALL(publisher_, publish(_))
+        .WillByDefault(Invoke([this](const envoy::service::mgw_res::v3::CheckRequest& request) {
+          published_.push_back(request.request_id());
+        }));
+  }
+
+  // A stream whose request differs from that of any other in its timings, byte counts and id.
+  std::unique_ptr<Stream> createStream(const std::string& method = "GET",
+                                       std::chrono::milliseconds timeout = Timeout) {
+    auto stream = std::make_unique<Stream>(method);
+    stream->request_.set_response_code(200);
+    stream->request_.set_route_name("route");
+    stream->request_.set_cluster_name("cluster");
+    stream->request_.set_upstream_connect_ns(streams_ * 1000);
+    stream->request_.set_request_bytes(streams_ * 10);
+    stream->request_.set_request_id(std::to_string(streams_));
+    streams_++;
+    stream->client_ = std::make_unique<SingleFlightResClient>(
+        table_, timeout, [this](std::chrono::milliseconds call_timeout) -> ResClientPtr {
+          auto client = std::make_unique<NiceMock<MockResClient>>();
+          EXPECT_CALL(*client, intercept(_, _, _, _))
+              .WillOnce(Invoke([this](ResponseCallbacks& callbacks,
+                                      const envoy::service::mgw_res::v3::CheckRequest&,
+                                      Tracing::Span&, const StreamInfo::StreamInfo&) -> void {
+                upstream_callbacks_ = &callbacks;
+              }));
+          upstream_timeouts_.push_back(call_timeout);
+          return client;
+        });
+    return stream;
+  }
+
+  void intercept(Stream& stream) {
+    stream.client_->intercept(stream.callbacks_, stream.request_, stream.span_,
+                              stream.stream_info_);
+  }
+
+  // Answers the last call made upstream.
+  void respond() {
+    ResponsePtr response = createResponse();
+    response->status = CheckStatus::OK;
+    upstream_callbacks_->onResponseComplete(std::move(response));
+  }
+
+  Event::SimulatedTimeSystem time_system_;
+  Stats::IsolatedStoreImpl store_;
+  ResSingleFlightStatsSharedPtr stats_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  NiceMock<MockResPublisher> publisher_;
+  ResSingleFlight table_;
+  uint32_t streams_{};
+  // The timeout of each call made upstream.
+  std::vector<std::chrono::milliseconds> upstream_timeouts_;
+  ResponseCallbacks* upstream_callbacks_{};
+  // Ids of the requests published.
+  std::vector<std::string> published_;
+};
+
+// Two concurrent calls for the same route, cluster, method, status and headers make one call
+// upstream, and both get its answer. The request of the call that joined is published.
+TEST_F(ResSingleFlightTest, IdenticalCallsShareOneCall) {
+  std::unique_ptr<Stream> first = createStream();
+  std::unique_ptr<Stream> second = createStream();
+  for (Stream* stream : {first.get(), second.get()}) {
+    auto* header = stream->request_.add_response_headers();
+    header->set_name("x-cache");
+    header->set_value("miss");
+  }
+  intercept(*first);
+  intercept(*second);
+  EXPECT_EQ(1U, upstream_timeouts_.size());
+  EXPECT_EQ(1U, stats_->calls_.value());
+  EXPECT_EQ(1U, stats_->coalesced_.value());
+  EXPECT_TRUE(published_.empty());
+
+  EXPECT_CALL(first->callbacks_, onResponseComplete_(CheckStatus::OK));
+  EXPECT_CALL(second->callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond();
+  EXPECT_THAT(published_, ElementsAre("1"));
+}
+
+// A call that would fail before the one in flight is answered does not wait for it.
+TEST_F(ResSingleFlightTest, EarlierDeadlineCallsOnItsOwn) {
+  std::unique_ptr<Stream> first = createStream();
+  std::unique_ptr<Stream> second = createStream("GET", Timeout / 2);
+  intercept(*first);
+  intercept(*second);
+  EXPECT_THAT(upstream_timeouts_, ElementsAre(Timeout, Timeout / 2));
+  EXPECT_EQ(1U, stats_->deadline_bypassed_.value());
+  EXPECT_EQ(0U, stats_->coalesced_.value());
+
+  EXPECT_CALL(second->callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond();
+  first->client_->cancel();
+  EXPECT_TRUE(published_.empty());
+}
+
+// When the call's maker is cancelled the call is made again for the waiter with the earliest
+// deadline, with the time it has left.
+TEST_F(ResSingleFlightTest, RestartForEarliestDeadline) {
+  std::unique_ptr<Stream> first = createStream();
+  std::unique_ptr<Stream> second = createStream("GET", 3 * Timeout);
+  std::unique_ptr<Stream> third = createStream("GET", 2 * Timeout);
+  intercept(*first);
+  intercept(*second);
+  intercept(*third);
+  EXPECT_EQ(2U, stats_->coalesced_.value());
+
+  time_system_.sleep(Timeout / 2);
+  first->client_->cancel();
+  EXPECT_EQ(1U, stats_->restarted_.value());
+  EXPECT_THAT(upstream_timeouts_, ElementsAre(Timeout, 2 * Timeout - Timeout / 2));
+
+  EXPECT_CALL(second->callbacks_, onResponseComplete_(CheckStatus::OK));
+  EXPECT_CALL(third->callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond();
+  EXPECT_THAT(published_, ElementsAre("1"));
+}
+
+TEST_F(ResSingleFlightTest, DifferentMethodsCallSeparately) {
+  std::unique_ptr<Stream> get = createStream("GET");
+  std::unique_ptr<Stream> post = createStream("POST");
+  intercept(*get);
+  intercept(*post);
+  EXPECT_EQ(2U, upstream_timeouts_.size());
+  EXPECT_EQ(0U, stats_->coalesced_.value());
+
+  EXPECT_CALL(post->callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond();
+  get->client_->cancel();
+}
+
+// A response with an empty projected header is not the same as one without the header.
+TEST_F(ResSingleFlightTest, HeaderPresenceSeparatesCalls) {
+  std::unique_ptr<Stream> empty = createStream();
+  auto* header = empty->request_.add_response_headers();
+  header->set_name("x-cache");
+  std::unique_ptr<Stream> missing = createStream();
+  intercept(*empty);
+  intercept(*missing);
+  EXPECT_EQ(2U, upstream_timeouts_.size());
+
+  EXPECT_CALL(missing->callbacks_, onResponseComplete_(CheckStatus::OK));
+  respond();
+  empty->client_->cancel();
+}
+
+} // namespace
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,281 @@
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <csignal>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/common/fmt.h"
+#include "common/stats/isolated_store_impl.h"
+
+#include "mgw-source/filters/common/mgw/mgw_res_spool.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/test_common/environment.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::ElementsAre;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace Filters {
+namespace Common {
+namespace MGW {
+namespace {
+
+constexpr uint32_t SegmentBytes = 4096;
+// Segment header, then records of a 4 byte length and the serialized request.
+constexpr uint32_t SegmentHeaderBytes = 16;
+constexpr uint32_t RecordBytes = 4 + 102;
+constexpr uint32_t RecordsPerSegment = (SegmentBytes - SegmentHeaderBytes) / RecordBytes;
+
+// A request that serializes to 102 bytes, named after its position.
+envoy::service::mgw_res::v3::CheckRequest request(uint32_t index) {
+  envoy::service::mgw_res::v3::CheckRequest request;
+  request.set_route_name(fmt::format("{:0100}", index));
+  return request;
+}
+
+class ResSpoolTest : public testing::Test {
+public:
+  ResSpoolTest() : directory_(TestEnvironment::temporaryPath("mgw_spool")) {
+    TestEnvironment::removePath(directory_);
+    TestEnvironment::createPath(directory_);
+    stats_ = std::make_shared<ResSpoolStats>(ResSpool::generateStats("spool.", store_));
+  }
+
+  ~ResSpoolTest() override { TestEnvironment::removePath(directory_); }
+
+  ResSpoolPtr createSpool(uint64_t max_bytes = 16 * SegmentBytes, uint32_t replay_rate = 100) {
+    replay_timer_ = new NiceMock<Event::MockTimer>(&dispatcher_);
+    auto spool = std::make_unique<ResSpool>(ResSpoolConfig{max_bytes, SegmentBytes, replay_rate},
+                                            directory_, stats_, dispatcher_);
+    spool->setReplayCallback(
+        [this](const envoy::service::mgw_res::v3::CheckRequest& request) -> void {
+          replayed_.push_back(std::stoul(request.route_name()));
+        });
+    return spool;
+  }
+
+  void append(ResSpool& spool, uint32_t first, uint32_t count) {
+    for (uint32_t index = first; index < first + count; index++) {
+      spool.append(request(index));
+    }
+  }
+
+  // Replays from the timer of the last spool created until it has nothing left.
+  void replayAll(ResSpool& spool) {
+    spool.setReplayEnabled(true);
+    while (replay_timer_->enabled()) {
+      replay_timer_->invokeCallback();
+    }
+  }
+
+  std::string segmentPath(uint32_t worker, uint64_t sequence) {
+    return fmt::format("{}/worker_{}/segment_{:020}.log", directory_, worker, sequence);
+  }
+
+  const std::string directory_;
+  Stats::IsolatedStoreImpl store_;
+  ResSpoolStatsSharedPtr stats_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  Event::MockTimer* replay_timer_;
+  std::vector<uint32_t> replayed_;
+};
+
+TEST_F(ResSpoolTest, Append) {
+  ResSpoolPtr spool = createSpool();
+  append(*spool, 0, 3);
+  EXPECT_EQ(3U, stats_->events_spooled_.value());
+  EXPECT_EQ(SegmentBytes, stats_->bytes_.value());
+  EXPECT_EQ(0, ::access(segmentPath(0, 0).c_str(), F_OK));
+  // Nothing is replayed before the publisher reports the service healthy.
+  EXPECT_FALSE(replay_timer_->enabled());
+
+  replayAll(*spool);
+  EXPECT_THAT(replayed_, ElementsAre(0, 1, 2));
+  EXPECT_EQ(3U, stats_->events_replayed_.value());
+  EXPECT_EQ(0U, stats_->bytes_.value());
+}
+
+TEST_F(ResSpoolTest, Roll) {
+  ResSpoolPtr spool = createSpool();
+  append(*spool, 0, RecordsPerSegment);
+  EXPECT_EQ(SegmentBytes, stats_->bytes_.value());
+  append(*spool, RecordsPerSegment, 1);
+  EXPECT_EQ(2 * SegmentBytes, stats_->bytes_.value());
+  EXPECT_EQ(0, ::access(segmentPath(0, 1).c_str(), F_OK));
+}
+
+// A request that does not fit in an empty segment is dropped.
+TEST_F(ResSpoolTest, OversizedRequestDropped) {
+  ResSpoolPtr spool = createSpool();
+  envoy::service::mgw_res::v3::CheckRequest oversized;
+  oversized.set_route_name(std::string(SegmentBytes, 'r'));
+  spool->append(oversized);
+  EXPECT_EQ(1U, stats_->events_dropped_.value());
+  EXPECT_EQ(0U, stats_->bytes_.value());
+}
+
+// A segment whose space cannot be reserved is removed, and the request dropped.
+TEST_F(ResSpoolTest, AllocationFailureDropped) {
+  ResSpoolPtr spool = createSpool();
+  // Files may not grow, which fails the allocation with EFBIG rather than raising SIGXFSZ.
+  struct rlimit limit;
+  ASSERT_EQ(0, ::getrlimit(RLIMIT_FSIZE, &limit));
+  const struct rlimit lowered = {1, limit.rlim_max};
+  auto* const handler = ::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, ::setrlimit(RLIMIT_FSIZE, &lowered));
+  append(*spool, 0, 1);
+  ::setrlimit(RLIMIT_FSIZE, &limit);
+  ::signal(SIGXFSZ, handler);
+
+  EXPECT_EQ(1U, stats_->events_dropped_.value());
+  EXPECT_EQ(0U, stats_->bytes_.value());
+  EXPECT_NE(0, ::access(segmentPath(0, 0).c_str(), F_OK));
+
+  // Once there is room again the next segment is used.
+  append(*spool, 1, 1);
+  EXPECT_EQ(1U, stats_->events_spooled_.value());
+  replayAll(*spool);
+  EXPECT_THAT(replayed_, ElementsAre(1));
+}
+
+// At the byte cap a new segment evicts the oldest one and the requests left in it.
+TEST_F(ResSpoolTest, EvictOldestAtByteCap) {
+  ResSpoolPtr spool = createSpool(3 * SegmentBytes);
+  append(*spool, 0, 3 * RecordsPerSegment);
+  EXPECT_EQ(0U, stats_->segments_evicted_.value());
+
+  append(*spool, 3 * RecordsPerSegment, 1);
+  EXPECT_EQ(1U, stats_->segments_evicted_.value());
+  EXPECT_EQ(RecordsPerSegment, stats_->events_evicted_.value());
+  EXPECT_EQ(3 * SegmentBytes, stats_->bytes_.value());
+  EXPECT_NE(0, ::access(segmentPath(0, 0).c_str(), F_OK));
+
+  replayAll(*spool);
+  ASSERT_EQ(2 * RecordsPerSegment + 1, replayed_.size());
+  EXPECT_EQ(RecordsPerSegment, replayed_.front());
+  EXPECT_EQ(3 * RecordsPerSegment, replayed_.back());
+}
+
+// Requests come back in the order they were spooled, across segments and at the replay rate.
+TEST_F(ResSpoolTest, ReplayOrdering) {
+  ResSpoolPtr spool = createSpool(16 * SegmentBytes, 100);
+  const uint32_t count = 2 * RecordsPerSegment + 5;
+  append(*spool, 0, count);
+
+  spool->setReplayEnabled(true);
+  replay_timer_->invokeCallback();
+  // 100 per second replays 10 per 100ms tick.
+  EXPECT_EQ(10U, replayed_.size());
+
+  // Replay stops while the service fails and picks up where it was.
+  spool->setReplayEnabled(false);
+  EXPECT_FALSE(replay_timer_->enabled());
+  replayAll(*spool);
+  ASSERT_EQ(count, replayed_.size());
+  for (uint32_t index = 0; index < count; index++) {
+    EXPECT_EQ(index, replayed_[index]);
+  }
+  EXPECT_EQ(0U, stats_->bytes_.value());
+}
+
+// A request spooled again while replaying goes to the end.
+TEST_F(ResSpoolTest, ReplayedRequestSpooledAgain) {
+  ResSpoolPtr spool = createSpool();
+  append(*spool, 0, 3);
+  bool failed = false;
+  spool->setReplayCallback(
+      [&](const envoy::service::mgw_res::v3::CheckRequest& request) -> void {
+        const uint32_t index = std::stoul(request.route_name());
+        if (index == 1 && !failed) {
+          failed = true;
+          spool->append(request);
+          return;
+        }
+        replayed_.push_back(index);
+      });
+  replayAll(*spool);
+  EXPECT_THAT(replayed_, ElementsAre(0, 2, 1));
+}
+
+// A restarted process replays what the last one spooled, from where it stopped.
+TEST_F(ResSpoolTest, Resume) {
+  {
+    ResSpoolPtr spool = createSpool(16 * SegmentBytes, 10);
+    append(*spool, 0, RecordsPerSegment + 2);
+    spool->setReplayEnabled(true);
+    replay_timer_->invokeCallback();
+    EXPECT_THAT(replayed_, ElementsAre(0));
+  }
+  replayed_.clear();
+
+  ResSpoolPtr spool = createSpool();
+  EXPECT_EQ(2 * SegmentBytes, stats_->bytes_.value());
+  replayAll(*spool);
+  ASSERT_EQ(RecordsPerSegment + 1, replayed_.size());
+  EXPECT_EQ(1U, replayed_.front());
+  EXPECT_EQ(RecordsPerSegment + 1, replayed_.back());
+}
+
+// A process that died between writing a payload and its length leaves a zero length behind. The
+// resumed spool ends its records there and writes over the torn one.
+TEST_F(ResSpoolTest, ResumeAfterTornWrite) {
+  {
+    ResSpoolPtr spool = createSpool();
+    append(*spool, 0, 3);
+  }
+
+  // The torn payload is twice as long as a record, and past the first record length it happens
+  // to hold what looks like another record.
+  std::string torn(2 * RecordBytes, 'x');
+  const uint32_t length = RecordBytes - 4;
+  memcpy(&torn[RecordBytes - 4], &length, sizeof(length));
+  request(99).SerializeToArray(&torn[RecordBytes], length);
+  const int fd = ::open(segmentPath(0, 0).c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(static_cast<ssize_t>(torn.size()),
+            ::pwrite(fd, torn.data(), torn.size(), SegmentHeaderBytes + 3 * RecordBytes + 4));
+  ::close(fd);
+
+  {
+    ResSpoolPtr spool = createSpool();
+    append(*spool, 3, 1);
+  }
+  ResSpoolPtr spool = createSpool();
+  replayAll(*spool);
+  EXPECT_THAT(replayed_, ElementsAre(0, 1, 2, 3));
+  EXPECT_EQ(0U, stats_->events_dropped_.value());
+}
+
+// A second spool on the same directory takes the next worker subdirectory, and the first one is
+// free for a later spool once its owner is gone.
+TEST_F(ResSpoolTest, LockContention) {
+  ResSpoolPtr first = createSpool();
+  append(*first, 0, 2);
+  ResSpoolPtr second = createSpool();
+  append(*second, 10, 2);
+  EXPECT_EQ(0, ::access(segmentPath(0, 0).c_str(), F_OK));
+  EXPECT_EQ(0, ::access(segmentPath(1, 0).c_str(), F_OK));
+
+  first.reset();
+  ResSpoolPtr third = createSpool();
+  replayAll(*third);
+  EXPECT_THAT(replayed_, ElementsAre(0, 1));
+}
+
+} // namespace
+} // namespace MGW
+} // namespace Common
+} // namespace Filters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,296 @@
+// Load harness for the mgw filter. Drives HTTP load through a real Envoy with the filter in front
+// of an autonomous upstream, while intercepts go to an in-process FakeMGWResponseServer that can
+// be slowed down, failed or stalled. Every scenario runs the same load twice on one proxy: on a
+// route where the filter skips the response and on one where it intercepts it. The difference is
+// the latency the filter adds. Results are recorded as test properties, which end up in the test's
+// XML output, and checked against what each mode promises.
+//
+// The target is manual, so it only runs when named. For real numbers, build with -c opt and raise
+// the load:
+//   MGW_LOAD_REQUESTS=200000 MGW_LOAD_CONNECTIONS=64 \
+//     bazel test -c opt //mgw-test/filters/http/mgw:analytics_load_test
+// Each load fails if it takes longer than MGW_LOAD_TIMEOUT_S, 300 seconds by default.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "envoy/config/bootstrap/v3/bootstrap.pb.h"
+#include "envoy/config/cluster/v3/cluster.pb.h"
+#include "envoy/extensions/filters/network/http_connection_manager/v3/http_connection_manager.pb.h"
+
+#include "mgw-api/extensions/filters/http/mgw/v3/mgw.pb.h"
+#include "mgw-test/filters/http/mgw/fake_mgw_response_server.h"
+
+#include "test/integration/http_integration.h"
+#include "test/test_common/environment.h"
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace MGW {
+namespace {
+
+constexpr char BaselinePath[] = "/baseline";
+constexpr char InterceptedPath[] = "/intercepted";
+
+uint32_t envOrDefault(const char* name, uint32_t default_value) {
+  const char* value = std::getenv(name);
+  return value != nullptr ? static_cast<uint32_t>(std::stoul(value)) : default_value;
+}
+
+struct LoadResult {
+  // Per request latency in microseconds, sorted. Only requests that got a response.
+  std::vector<uint64_t> latencies_us_;
+  // Requests whose stream was reset before the response completed.
+  uint64_t resets_{};
+  double seconds_{};
+
+  uint64_t percentile(double p) const {
+    if (latencies_us_.empty()) {
+      return 0;
+    }
+    const size_t index = std::min(latencies_us_.size() - 1,
+                                  static_cast<size_t>(p * latencies_us_.size()));
+    return latencies_us_[index];
+  }
+  double rps() const { return seconds_ > 0 ? latencies_us_.size() / seconds_ : 0; }
+};
+
+// Parameterized on the number of proxy worker threads.
+class MGWLoadTest : public testing::TestWithParam<uint32_t>, public HttpIntegrationTest {
+public:
+  MGWLoadTest()
+      : HttpIntegrationTest(Http::CodecClient::Type::HTTP1,
+                            TestEnvironment::getIpVersionsForTest().front()) {
+    autonomous_upstream_ = true;
+    concurrency_ = GetParam();
+  }
+
+  // Starts the fake service, then a proxy whose mgw filter is configured with filter_yaml plus the
+  // grpc_service pointing at the fake. filter_yaml holds MGW fields indented by two spaces.
+  void initializeWith(const std::string& filter_yaml,
+                      const FakeMGWResponseServer::Options& options) {
+    server_ = std::make_unique<FakeMGWResponseServer>(options);
+
+    config_helper_.addConfigModifier([this](envoy::config::bootstrap::v3::Bootstrap& bootstrap) {
+      // A copy of the upstream cluster, pointed at the fake service over HTTP/2.
+      envoy::config::cluster::v3::Cluster mgw_cluster = bootstrap.static_resources().clusters(0);
+      mgw_cluster.set_name("mgw_res");
+      mgw_cluster.mutable_http2_protocol_options();
+      auto* address = mgw_cluster.mutable_load_assignment()
+                          ->mutable_endpoints(0)
+                          ->mutable_lb_endpoints(0)
+                          ->mutable_endpoint()
+                          ->mutable_address()
+                          ->mutable_socket_address();
+      address->set_address("127.0.0.1");
+      // A preset port is left alone when the upstream ports are filled in.
+      address->set_port_value(server_->port());
+      *bootstrap.mutable_static_resources()->add_clusters() = mgw_cluster;
+    });
+
+    config_helper_.addConfigModifier(
+        [](envoy::extensions::filters::network::http_connection_manager::v3::HttpConnectionManager&
+               hcm) {
+          // The baseline route goes through the same filter chain, but the filter skips it.
+          auto* virtual_host = hcm.mutable_route_config()->mutable_virtual_hosts(0);
+          auto* baseline = virtual_host->add_routes();
+          *baseline = virtual_host->routes(0);
+          baseline->mutable_match()->set_prefix(BaselinePath);
+          envoy::extensions::filters::http::mgw::v3::MGWPerRoute per_route;
+          per_route.set_disabled(true);
+          (*baseline->mutable_typed_per_filter_config())["envoy.filters.http.mgw"].PackFrom(
+              per_route);
+          virtual_host->mutable_routes()->SwapElements(0, virtual_host->routes_size() - 1);
+        });
+
+    config_helper_.addFilter(absl::StrCat(R"EOF(
+name: envoy.filters.http.mgw
+typed_config:
+  "@type": type.googleapis.com/envoy.extensions.filters.http.mgw.v3.MGW
+  grpc_service:
+    envoy_grpc:
+      cluster_name: mgw_res
+    timeout: 0.2s
+)EOF",
+                                          filter_yaml));
+    HttpIntegrationTest::initialize();
+  }
+
+  // Sends requests on the path over a fixed set of connections, one request in flight on each.
+  // Gives up with a failure once the deadline passes, so a stalled stream cannot hang the test.
+  LoadResult drive(const std::string& path) {
+    const uint32_t requests = envOrDefault("MGW_LOAD_REQUESTS", 500);
+    const uint32_t connections = std::min(requests, envOrDefault("MGW_LOAD_CONNECTIONS", 16));
+    const std::chrono::seconds timeout(envOrDefault("MGW_LOAD_TIMEOUT_S", 300));
+    Http::TestRequestHeaderMapImpl headers{
+        {":method", "GET"}, {":path", path}, {":scheme", "http"}, {":authority", "host"}};
+
+    std::vector<IntegrationCodecClientPtr> clients;
+    std::vector<IntegrationStreamDecoderPtr> responses(connections);
+    std::vector<MonotonicTime> started(connections);
+    for (uint32_t i = 0; i < connections; ++i) {
+      clients.push_back(makeHttpConnection(lookupPort("http")));
+    }
+
+    LoadResult result;
+    result.latencies_us_.reserve(requests);
+    uint32_t sent = 0;
+    auto send = [&](uint32_t i) {
+      started[i] = timeSystem().monotonicTime();
+      responses[i] = clients[i]->makeHeaderOnlyRequest(headers);
+      ++sent;
+    };
+
+    const MonotonicTime start = timeSystem().monotonicTime();
+    const MonotonicTime deadline = start + timeout;
+    for (uint32_t i = 0; i < connections; ++i) {
+      send(i);
+    }
+    while (result.latencies_us_.size() + result.resets_ < requests) {
+      if (timeSystem().monotonicTime() >= deadline) {
+        ADD_FAILURE() << "load on " << path << " did not finish within " << timeout.count()
+                      << "s: " << result.latencies_us_.size() << " responses and "
+                      << result.resets_ << " resets of " << requests << " requests";
+        break;
+      }
+      dispatcher_->run(Event::Dispatcher::RunType::NonBlock);
+      for (uint32_t i = 0; i < connections; ++i) {
+        if (responses[i] == nullptr) {
+          continue;
+        }
+        if (responses[i]->reset()) {
+          ++result.resets_;
+          if (!clients[i]->connected()) {
+            clients[i]->close();
+            clients[i] = makeHttpConnection(lookupPort("http"));
+          }
+        } else if (responses[i]->complete()) {
+          EXPECT_EQ("200", responses[i]->headers().getStatusValue());
+          result.latencies_us_.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                             timeSystem().monotonicTime() - started[i])
+                                             .count());
+        } else {
+          continue;
+        }
+        responses[i].reset();
+        if (sent < requests) {
+          send(i);
+        }
+      }
+    }
+    result.seconds_ =
+        std::chrono::duration<double>(timeSystem().monotonicTime() - start).count();
+
+    for (auto& client : clients) {
+      client->close();
+    }
+    std::sort(result.latencies_us_.begin(), result.latencies_us_.end());
+    return result;
+  }
+
+  // Runs the baseline and the intercepted load and records both plus the difference.
+  void runScenario() {
+    baseline_ = drive(BaselinePath);
+    intercepted_ = drive(InterceptedPath);
+    const std::vector<std::pair<std::string, double>> percentiles{
+        {"p50", 0.5}, {"p99", 0.99}, {"p999", 0.999}};
+    for (const auto& [name, p] : percentiles) {
+      const std::string suffix = absl::StrCat("_", name, "_us");
+      RecordProperty(absl::StrCat("baseline", suffix), std::to_string(baseline_.percentile(p)));
+      RecordProperty(absl::StrCat("intercepted", suffix),
+                     std::to_string(intercepted_.percentile(p)));
+      RecordProperty(absl::StrCat("added", suffix), std::to_string(added(p)));
+    }
+    RecordProperty("baseline_rps", std::to_string(static_cast<uint64_t>(baseline_.rps())));
+    RecordProperty("intercepted_rps", std::to_string(static_cast<uint64_t>(intercepted_.rps())));
+    RecordProperty("baseline_resets", std::to_string(baseline_.resets_));
+    RecordProperty("intercepted_resets", std::to_string(intercepted_.resets_));
+    RecordProperty("service_events", std::to_string(server_->events()));
+  }
+
+  // Latency the filter added at the percentile, in microseconds.
+  int64_t added(double p) const {
+    return static_cast<int64_t>(intercepted_.percentile(p)) -
+           static_cast<int64_t>(baseline_.percentile(p));
+  }
+
+  void TearDown() override {
+    // The proxy goes first so that nothing is still calling the fake service.
+    cleanupUpstreamAndDownstream();
+    test_server_.reset();
+    server_.reset();
+  }
+
+  // Answers after 20ms, fails 10% of calls and stalls 1% for a second.
+  static FakeMGWResponseServer::Options degraded() {
+    FakeMGWResponseServer::Options options;
+    options.latency_ = DegradedLatency;
+    options.error_rate_ = 0.1;
+    options.stall_rate_ = 0.01;
+    options.stall_ = std::chrono::milliseconds(1000);
+    return options;
+  }
+
+  // The fake service's answer latency in degraded(), which observe-only modes must not add.
+  static constexpr std::chrono::milliseconds DegradedLatency{20};
+
+  std::unique_ptr<FakeMGWResponseServer> server_;
+  LoadResult baseline_;
+  LoadResult intercepted_;
+};
+
+INSTANTIATE_TEST_SUITE_P(Workers, MGWLoadTest, testing::Values(1, 2, 4));
+
+TEST_P(MGWLoadTest, SyncHealthy) {
+  initializeWith("  mode: SYNC\n", {});
+  runScenario();
+  // Every intercepted response made a call.
+  EXPECT_GE(server_->events(), intercepted_.latencies_us_.size());
+}
+
+TEST_P(MGWLoadTest, SyncDegraded) {
+  initializeWith("  mode: SYNC\n", degraded());
+  runScenario();
+  // The 200ms call timeout keeps the one second stalls away from the responses.
+  EXPECT_LT(intercepted_.percentile(0.999), uint64_t{1000000});
+}
+
+TEST_P(MGWLoadTest, AsyncUnaryDegraded) {
+  initializeWith("  mode: ASYNC\n", degraded());
+  runScenario();
+  EXPECT_LT(added(0.5), std::chrono::microseconds(DegradedLatency).count());
+}
+
+TEST_P(MGWLoadTest, AsyncBatchDegraded) {
+  initializeWith("  mode: ASYNC\n  batch: {}\n", degraded());
+  runScenario();
+  EXPECT_LT(added(0.5), std::chrono::microseconds(DegradedLatency).count());
+}
+
+TEST_P(MGWLoadTest, AsyncStreamDegraded) {
+  initializeWith("  mode: ASYNC\n  stream: {}\n", degraded());
+  runScenario();
+  EXPECT_LT(added(0.5), std::chrono::microseconds(DegradedLatency).count());
+}
+
+TEST_P(MGWLoadTest, AggregateDegraded) {
+  initializeWith("  mode: AGGREGATE\n  aggregation: {interval: 1s}\n", degraded());
+  runScenario();
+  EXPECT_LT(added(0.5), std::chrono::microseconds(DegradedLatency).count());
+}
+
+} // namespace
+} // namespace MGW
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
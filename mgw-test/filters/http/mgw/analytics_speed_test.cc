@@ -0,0 +1,386 @@
+// Microbenchmarks of the mgw filter hot path. Each iteration runs one response through a fresh
+// filter, the way the filter chain does: encodeHeaders, encodeData and, in SYNC mode,
+// onResponseComplete. The response client is a fake that answers either inside intercept() or
+// later, so only the filter and its per worker state are measured. ns/op is reported by the
+// benchmark library; allocs/op is added when running on tcmalloc.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "envoy/config/core/v3/grpc_service.pb.h"
+
+#include "common/buffer/buffer_impl.h"
+#include "common/common/macros.h"
+#include "common/http/context_impl.h"
+#include "common/stats/isolated_store_impl.h"
+#include "common/tracing/http_tracer_impl.h"
+
+#include "mgw-api/extensions/filters/http/mgw/v3/mgw.pb.h"
+#include "mgw-source/filters/common/mgw/mgw_res_grpc_impl.h"
+#include "mgw-source/filters/http/mgw/analytics.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/grpc/mocks.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/local_info/mocks.h"
+#include "test/mocks/runtime/mocks.h"
+#include "test/mocks/stream_info/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+
+#ifdef TCMALLOC
+#include "gperftools/malloc_hook.h"
+#endif
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace MGW {
+namespace {
+
+using MGWConfig = envoy::extensions::filters::http::mgw::v3::MGW;
+
+#ifdef TCMALLOC
+std::atomic<uint64_t> allocations{0};
+
+void countAllocation(const void*, size_t) { allocations.fetch_add(1, std::memory_order_relaxed); }
+#endif
+
+uint64_t allocationCount() {
+#ifdef TCMALLOC
+  return allocations.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif
+}
+
+// Reports the allocations made since start as allocs/op. Nothing is reported without tcmalloc.
+void reportAllocations(benchmark::State& state, uint64_t start) {
+#ifdef TCMALLOC
+  state.counters["allocs/op"] =
+      benchmark::Counter(allocationCount() - start, benchmark::Counter::kAvgIterations);
+#else
+  UNREFERENCED_PARAMETER(state);
+  UNREFERENCED_PARAMETER(start);
+#endif
+}
+
+// Answers every intercept() with OK, either from inside the call or when complete() is called.
+class FakeResClient : public Filters::Common::MGW::ResClient {
+public:
+  explicit FakeResClient(bool inline_completion) : inline_completion_(inline_completion) {}
+
+  // Filters::Common::MGW::ResClient
+  void cancel() override { callbacks_ = nullptr; }
+  void intercept(Filters::Common::MGW::ResponseCallbacks& callbacks,
+                 const envoy::service::mgw_res::v3::CheckRequest&, Tracing::Span&,
+                 const StreamInfo::StreamInfo&) override {
+    callbacks_ = &callbacks;
+    if (inline_completion_) {
+      complete();
+    }
+  }
+
+  void complete() {
+    Filters::Common::MGW::ResponsePtr response = Filters::Common::MGW::createResponse();
+    response->status = Filters::Common::MGW::CheckStatus::OK;
+    Filters::Common::MGW::ResponseCallbacks* callbacks = callbacks_;
+    callbacks_ = nullptr;
+    callbacks->onResponseComplete(std::move(response));
+  }
+
+private:
+  const bool inline_completion_;
+  Filters::Common::MGW::ResponseCallbacks* callbacks_{};
+};
+
+// Owns a filter config and everything it needs. gRPC clients are mocks that accept and drop
+// every call.
+class FilterBenchmark {
+public:
+  explicit FilterBenchmark(const MGWConfig& proto_config) {
+#ifdef TCMALLOC
+    MallocHook::AddNewHook(&countAllocation);
+#endif
+    ON_CALL(async_client_manager_, factoryForGrpcService(_, _, _))
+        .WillByDefault(Invoke([](const envoy::config::core::v3::GrpcService&, Stats::Scope&,
+                                 bool) -> Grpc::AsyncClientFactoryPtr {
+          auto factory = std::make_unique<NiceMock<Grpc::MockAsyncClientFactory>>();
+          ON_CALL(*factory, create()).WillByDefault(Invoke([]() -> Grpc::RawAsyncClientPtr {
+            return std::make_unique<NiceMock<Grpc::MockAsyncClient>>();
+          }));
+          return factory;
+        }));
+    config_ = std::make_shared<FilterConfig>(proto_config, local_info_, store_, runtime_,
+                                             http_context_, "", tls_, async_client_manager_,
+                                             random_, dispatcher_, std::chrono::milliseconds(200));
+  }
+
+  ~FilterBenchmark() {
+#ifdef TCMALLOC
+    MallocHook::RemoveNewHook(&countAllocation);
+#endif
+  }
+
+  const FilterConfigSharedPtr& config() { return config_; }
+  Grpc::AsyncClientManager& asyncClientManager() { return async_client_manager_; }
+  Stats::Scope& scope() { return store_; }
+
+  // Runs one response through a new filter. If deferred is set, the call it holds is answered
+  // between the headers and the body.
+  void encodeResponse(Filters::Common::MGW::ResClientPtr&& client,
+                      FakeResClient* deferred = nullptr) {
+    auto filter = std::make_shared<Filter>(config_, std::move(client), nullptr);
+    filter->setEncoderFilterCallbacks(callbacks_);
+    filter->encodeHeaders(headers_, false);
+    if (deferred != nullptr) {
+      deferred->complete();
+    }
+    filter->encodeData(body_, true);
+    filter->onDestroy();
+  }
+
+private:
+  NiceMock<LocalInfo::MockLocalInfo> local_info_;
+  Stats::IsolatedStoreImpl store_;
+  NiceMock<Runtime::MockLoader> runtime_;
+  Http::ContextImpl http_context_{store_.symbolTable()};
+  NiceMock<ThreadLocal::MockInstance> tls_;
+  NiceMock<Grpc::MockAsyncClientManager> async_client_manager_;
+  NiceMock<Runtime::MockRandomGenerator> random_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  NiceMock<Http::MockStreamEncoderFilterCallbacks> callbacks_;
+  Http::TestResponseHeaderMapImpl headers_{
+      {":status", "200"}, {"content-type", "application/json"}, {"x-tenant-id", "tenant-1"}};
+  // Never drained by the filter, so the same body serves every iteration.
+  Buffer::OwnedImpl body_{std::string(1024, 'a')};
+  FilterConfigSharedPtr config_;
+};
+
+MGWConfig modeConfig(MGWConfig::Mode mode) {
+  MGWConfig proto_config;
+  proto_config.set_mode(mode);
+  return proto_config;
+}
+
+// SYNC mode, the service answers before intercept() returns.
+void BM_SyncInline(benchmark::State& state) {
+  FilterBenchmark bench(modeConfig(MGWConfig::SYNC));
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(std::make_unique<FakeResClient>(true));
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_SyncInline);
+
+// SYNC mode, the stream pauses and is resumed by onResponseComplete().
+void BM_SyncDeferred(benchmark::State& state) {
+  FilterBenchmark bench(modeConfig(MGWConfig::SYNC));
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    auto client = std::make_unique<FakeResClient>(false);
+    FakeResClient* deferred = client.get();
+    bench.encodeResponse(std::move(client), deferred);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_SyncDeferred);
+
+// SYNC mode with a local rule allowing 2xx JSON responses, so the service is never called.
+void BM_SyncLocalRule(benchmark::State& state) {
+  MGWConfig proto_config = modeConfig(MGWConfig::SYNC);
+  auto* rule = proto_config.add_response_rules();
+  auto* codes = rule->add_response_codes();
+  codes->set_start(200);
+  codes->set_end(300);
+  auto* header = rule->add_headers();
+  header->set_name("content-type");
+  header->mutable_value()->set_prefix("application/json");
+  FilterBenchmark bench(proto_config);
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_SyncLocalRule);
+
+// What a SYNC stream adds when its call starts: a client that borrows the worker's async client.
+void BM_SyncCreateClient(benchmark::State& state) {
+  FilterBenchmark bench(modeConfig(MGWConfig::SYNC));
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    auto client = std::make_unique<Filters::Common::MGW::GrpcResClientImpl>(
+        bench.config()->asyncClient(), bench.config()->timeout());
+    benchmark::DoNotOptimize(client);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_SyncCreateClient);
+
+// The per stream path BM_SyncCreateClient replaced: the factory is resolved through the async
+// client manager and a raw async client is created for every stream. The manager and its
+// factories are mocks, so the real lookup and client setup cost more than is shown here.
+void BM_SyncCreateClientPerStream(benchmark::State& state) {
+  FilterBenchmark bench(modeConfig(MGWConfig::SYNC));
+  envoy::config::core::v3::GrpcService grpc_service;
+  grpc_service.mutable_envoy_grpc()->set_cluster_name("mgw");
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    Grpc::AsyncClientFactoryPtr factory =
+        bench.asyncClientManager().factoryForGrpcService(grpc_service, bench.scope(), true);
+    auto client = std::make_unique<Filters::Common::MGW::GrpcResClientImpl>(
+        factory->create(), bench.config()->timeout());
+    benchmark::DoNotOptimize(client);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_SyncCreateClientPerStream);
+
+// Counts the answers a client delivers.
+class CountingCallbacks : public Filters::Common::MGW::ResponseCallbacks {
+public:
+  // Filters::Common::MGW::ResponseCallbacks
+  void onResponseComplete(Filters::Common::MGW::ResponsePtr&&) override { completed_++; }
+
+  uint64_t completed_{};
+};
+
+// Decoding the service's answer and handing it to the filter. Starting the call and buffering the
+// encoded answer belong to the mocks and the codec, so their allocations are reported apart as
+// setup_allocs/op.
+void BM_SyncDecodeResponse(benchmark::State& state) {
+  FilterBenchmark bench(modeConfig(MGWConfig::SYNC));
+  Filters::Common::MGW::GrpcResClientImpl client(bench.config()->asyncClient(),
+                                                 bench.config()->timeout());
+  envoy::service::mgw_res::v3::CheckResponse answer;
+  answer.mutable_status()->set_code(Grpc::Status::WellKnownGrpcStatus::Ok);
+  const std::string encoded = answer.SerializeAsString();
+  CountingCallbacks callbacks;
+  NiceMock<StreamInfo::MockStreamInfo> stream_info;
+  const envoy::service::mgw_res::v3::CheckRequest request;
+  uint64_t allocations_in_setup = 0;
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    const uint64_t setup_start = allocationCount();
+    client.intercept(callbacks, request, Tracing::NullSpan::instance(), stream_info);
+    auto buffer = std::make_unique<Buffer::OwnedImpl>(encoded);
+    allocations_in_setup += allocationCount() - setup_start;
+    client.onSuccessRaw(std::move(buffer), Tracing::NullSpan::instance());
+  }
+  state.counters["setup_allocs/op"] =
+      benchmark::Counter(allocations_in_setup, benchmark::Counter::kAvgIterations);
+  reportAllocations(state, start + allocations_in_setup);
+  benchmark::DoNotOptimize(callbacks.completed_);
+}
+BENCHMARK(BM_SyncDecodeResponse);
+
+// ASYNC mode with one unary call per response, including serialization.
+void BM_AsyncUnary(benchmark::State& state) {
+  FilterBenchmark bench(modeConfig(MGWConfig::ASYNC));
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_AsyncUnary);
+
+// ASYNC mode with batching. Batches of 100 are flushed from inside the loop.
+void BM_AsyncBatch(benchmark::State& state) {
+  MGWConfig proto_config = modeConfig(MGWConfig::ASYNC);
+  proto_config.mutable_batch()->mutable_max_events()->set_value(100);
+  FilterBenchmark bench(proto_config);
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_AsyncBatch);
+
+// ASYNC mode with a 1 KiB body captured per response.
+void BM_AsyncBodyCapture(benchmark::State& state) {
+  MGWConfig proto_config = modeConfig(MGWConfig::ASYNC);
+  proto_config.mutable_body_capture()->set_max_bytes(1024);
+  FilterBenchmark bench(proto_config);
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_AsyncBodyCapture);
+
+// ASYNC mode projecting content-type, x-tenant-id and then headers the response doesn't have, up
+// to the number given.
+void BM_AsyncProjectedHeaders(benchmark::State& state) {
+  MGWConfig proto_config = modeConfig(MGWConfig::ASYNC);
+  proto_config.add_response_headers()->set_name("content-type");
+  proto_config.add_response_headers()->set_name("x-tenant-id");
+  for (int64_t i = 2; i < state.range(0); i++) {
+    proto_config.add_response_headers()->set_name(absl::StrCat("x-missing-", i));
+  }
+  FilterBenchmark bench(proto_config);
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_AsyncProjectedHeaders)->Arg(2)->Arg(8);
+
+// ASYNC mode with tail sampling. Responses are fast 200s and no background rate is set, so each
+// one is dropped at the end of the stream without building its request.
+void BM_AsyncTailDropped(benchmark::State& state) {
+  MGWConfig proto_config = modeConfig(MGWConfig::ASYNC);
+  proto_config.mutable_tail_sampling()->mutable_latency_threshold()->set_seconds(1);
+  FilterBenchmark bench(proto_config);
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_AsyncTailDropped);
+
+// AGGREGATE mode, only the worker's rollups are touched.
+void BM_Aggregate(benchmark::State& state) {
+  FilterBenchmark bench(modeConfig(MGWConfig::AGGREGATE));
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_Aggregate);
+
+// Responses that lose the sampling roll. The floor cost of the filter.
+void BM_Unsampled(benchmark::State& state) {
+  MGWConfig proto_config = modeConfig(MGWConfig::ASYNC);
+  proto_config.mutable_sampling()->mutable_default_value()->set_numerator(0);
+  FilterBenchmark bench(proto_config);
+  const uint64_t start = allocationCount();
+  for (auto _ : state) {
+    bench.encodeResponse(nullptr);
+  }
+  reportAllocations(state, start);
+}
+BENCHMARK(BM_Unsampled);
+
+} // namespace
+} // namespace MGW
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
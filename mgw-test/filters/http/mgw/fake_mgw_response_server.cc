@@ -0,0 +1,85 @@
+#include "mgw-test/filters/http/mgw/fake_mgw_response_server.h"
+
+#include "common/common/assert.h"
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace MGW {
+
+FakeMGWResponseServer::FakeMGWResponseServer(const Options& options) : options_(options) {
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &port_);
+  builder.RegisterService(this);
+  server_ = builder.BuildAndStart();
+  RELEASE_ASSERT(server_ != nullptr && port_ != 0, "fake MGWResponse server failed to start");
+}
+
+FakeMGWResponseServer::~FakeMGWResponseServer() {
+  // Stalled calls are cut short rather than waited for.
+  server_->Shutdown(std::chrono::system_clock::now());
+  server_->Wait();
+}
+
+grpc::Status FakeMGWResponseServer::Intercept(grpc::ServerContext*,
+                                              const envoy::service::mgw_res::v3::CheckRequest*,
+                                              envoy::service::mgw_res::v3::CheckResponse*) {
+  return answer(1);
+}
+
+grpc::Status
+FakeMGWResponseServer::InterceptBatch(grpc::ServerContext*,
+                                      const envoy::service::mgw_res::v3::CheckRequestBatch* batch,
+                                      envoy::service::mgw_res::v3::CheckResponse*) {
+  return answer(batch->requests_size());
+}
+
+grpc::Status FakeMGWResponseServer::InterceptStream(
+    grpc::ServerContext*, grpc::ServerReader<envoy::service::mgw_res::v3::CheckRequest>* reader,
+    envoy::service::mgw_res::v3::CheckResponse*) {
+  envoy::service::mgw_res::v3::CheckRequest request;
+  while (reader->Read(&request)) {
+    // A stalled reader pushes back on the proxy through flow control.
+    const grpc::Status status = answer(1);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return grpc::Status::OK;
+}
+
+grpc::Status
+FakeMGWResponseServer::InterceptRollup(grpc::ServerContext*,
+                                       const envoy::service::mgw_res::v3::CheckRollup* rollup,
+                                       envoy::service::mgw_res::v3::CheckResponse*) {
+  uint64_t requests = 0;
+  for (const auto& entry : rollup->rollups()) {
+    requests += entry.requests();
+  }
+  return answer(requests);
+}
+
+grpc::Status FakeMGWResponseServer::answer(uint64_t events) {
+  events_ += events;
+  const std::chrono::milliseconds delay =
+      roll(options_.stall_rate_) ? options_.stall_ : options_.latency_;
+  if (delay.count() > 0) {
+    absl::SleepFor(absl::Milliseconds(delay.count()));
+  }
+  if (roll(options_.error_rate_)) {
+    return {grpc::StatusCode::UNAVAILABLE, "injected failure"};
+  }
+  return grpc::Status::OK;
+}
+
+bool FakeMGWResponseServer::roll(double rate) {
+  return rate > 0 && random_.random() % 1000000 < rate * 1000000;
+}
+
+} // namespace MGW
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
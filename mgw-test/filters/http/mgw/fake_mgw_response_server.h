@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "common/runtime/runtime_impl.h"
+
+#include "mgw-api/services/response/v3/mgw_res.grpc.pb.h"
+
+#include "grpcpp/grpcpp.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace MGW {
+
+/**
+ * In-process stand-in for an MGWResponse service, for load tests. Every RPC is answered after a
+ * configurable delay and can be made to fail or stall. Runs on its own gRPC threads, so a slow
+ * answer never holds up the proxy under test.
+ */
+class FakeMGWResponseServer final : public envoy::service::mgw_res::v3::MGWResponse::Service {
+public:
+  struct Options {
+    // Delay before every answer.
+    std::chrono::milliseconds latency_{0};
+    // Fraction of calls answered with UNAVAILABLE.
+    double error_rate_{0};
+    // Fraction of calls held for stall_ instead of latency_.
+    double stall_rate_{0};
+    std::chrono::milliseconds stall_{0};
+  };
+
+  explicit FakeMGWResponseServer(const Options& options);
+  ~FakeMGWResponseServer() override;
+
+  uint32_t port() const { return port_; }
+
+  /**
+   * @return the intercepted responses received so far, counting each batched or streamed one.
+   */
+  uint64_t events() const { return events_.load(); }
+
+  // envoy::service::mgw_res::v3::MGWResponse::Service
+  grpc::Status Intercept(grpc::ServerContext* context,
+                         const envoy::service::mgw_res::v3::CheckRequest* request,
+                         envoy::service::mgw_res::v3::CheckResponse* response) override;
+  grpc::Status InterceptBatch(grpc::ServerContext* context,
+                              const envoy::service::mgw_res::v3::CheckRequestBatch* batch,
+                              envoy::service::mgw_res::v3::CheckResponse* response) override;
+  grpc::Status
+  InterceptStream(grpc::ServerContext* context,
+                  grpc::ServerReader<envoy::service::mgw_res::v3::CheckRequest>* reader,
+                  envoy::service::mgw_res::v3::CheckResponse* response) override;
+  grpc::Status InterceptRollup(grpc::ServerContext* context,
+                               const envoy::service::mgw_res::v3::CheckRollup* rollup,
+                               envoy::service::mgw_res::v3::CheckResponse* response) override;
+
+private:
+  // Waits and rolls the dice for a call carrying the given number of events.
+  grpc::Status answer(uint64_t events);
+  bool roll(double rate);
+
+  const Options options_;
+  Runtime::RandomGeneratorImpl random_;
+  std::atomic<uint64_t> events_{0};
+  int port_{};
+  std::unique_ptr<grpc::Server> server_;
+};
+
+} // namespace MGW
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy